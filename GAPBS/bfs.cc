@@ -1,9 +1,17 @@
 // Copyright (c) 2015, The Regents of the University of California (Regents)
 // See LICENSE.txt for license details
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
+#include <memory>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#include <sched.h>
+#endif
+
 #include "benchmark.h"
 #include "bitmap.h"
 #include "builder.h"
@@ -34,6 +42,18 @@ them in parent array as negative numbers. Thus the encoding of parent is:
   parent[x] < 0 implies x is unvisited and parent[x] = -out_degree(x)
   parent[x] >= 0 implies x been visited
 
+The optional socket-partitioned engine (-p) splits the vertices into one
+edge-balanced range per socket. Each socket's threads hold a first-touched
+copy of the out and in edges of their range, own that range of the parent
+array, and only process frontier vertices they own. Top-down steps keep one
+queue per socket, and bottom-up steps keep a frontier bitmap replicated on
+every socket; each socket writes the words of its own range and the ranges
+are merged into all replicas at the end of each step, so neighbor checks read
+local memory. Instead of fixed alpha and beta, the engine meters every level
+with RAPL and derives them from the measured joules per top-down edge and per
+bottom-up edge (see DirectionTuner). Threads should be bound to cores (e.g.
+OMP_PROC_BIND=true) for the placement to hold.
+
 [1] Scott Beamer, Krste Asanović, and David Patterson. "Direction-Optimizing
     Breadth-First Search." International Conference on High Performance
     Computing, Networking, Storage and Analysis (SC), Salt Lake City, Utah,
@@ -43,6 +63,27 @@ them in parent array as negative numbers. Thus the encoding of parent is:
 
 using namespace std;
 
+
+class CLBFSApp : public CLApp {
+  bool partitioned_ = false;
+
+ public:
+  CLBFSApp(int argc, char** argv, std::string name) : CLApp(argc, argv, name) {
+    get_args_ += "p";
+    AddHelpLine('p', "", "socket-partitioned engine with tuned alpha/beta",
+                "false");
+  }
+
+  void HandleArg(signed char opt, char* opt_arg) override {
+    switch (opt) {
+      case 'p': partitioned_ = true;                   break;
+      default: CLApp::HandleArg(opt, opt_arg);
+    }
+  }
+
+  bool partitioned() const { return partitioned_; }
+};
+
 int64_t BUStep(const Graph &g, pvector<NodeID> &parent, Bitmap &front,
                Bitmap &next) {
   int64_t awake_count = 0;
@@ -173,6 +214,505 @@ pvector<NodeID> DOBFS(const Graph &g, NodeID source, int alpha = 15,
   return parent;
 }
 
+// Learns joules per edge checked top-down and bottom-up from RAPL readings
+// around each level, accumulated over every trial. Switching to bottom-up
+// pays off once scout_count * J_td > edges_to_check * r * J_bu, where r is
+// the measured fraction of unexplored edges bottom-up actually checks (it
+// stops at the first parent found), so alpha = J_td / (r * J_bu). Going back
+// to top-down pays off once the next top-down level, about awake_count times
+// the average degree, costs less than repeating the last bottom-up level,
+// which gives beta. Until both directions have been seen the defaults hold.
+class DirectionTuner {
+  double td_joules_ = 0, td_edges_ = 0;
+  double bu_joules_ = 0, bu_edges_ = 0, bu_unexplored_ = 0;
+
+  static int Clamp(double x) {
+    return static_cast<int>(min(max(x, 2.0), 1e6));
+  }
+
+ public:
+  void RecordTopDown(double joules, int64_t edges) {
+    td_joules_ += joules;
+    td_edges_ += edges;
+  }
+
+  void RecordBottomUp(double joules, int64_t edges, int64_t unexplored) {
+    bu_joules_ += joules;
+    bu_edges_ += edges;
+    bu_unexplored_ += unexplored;
+  }
+
+  bool Ready() const {
+    return (td_edges_ > 0) && (bu_edges_ > 0) && (td_joules_ > 0) &&
+           (bu_joules_ > 0);
+  }
+
+  int Alpha(int fallback) const {
+    if (!Ready())
+      return fallback;
+    double checked_fraction = bu_edges_ / max(bu_unexplored_, 1.0);
+    return Clamp((td_joules_ / td_edges_) /
+                 (checked_fraction * (bu_joules_ / bu_edges_)));
+  }
+
+  int Beta(int fallback, const Graph &g, int64_t last_bu_edges) const {
+    if (!Ready() || last_bu_edges == 0)
+      return fallback;
+    double avg_degree = static_cast<double>(g.num_edges_directed()) /
+                        g.num_nodes();
+    return Clamp(g.num_nodes() * (td_joules_ / td_edges_) * avg_degree /
+                 ((bu_joules_ / bu_edges_) * last_bu_edges));
+  }
+};
+
+
+// Copy of the graph split into one vertex range per socket. Ranges are
+// balanced by edges and aligned to 64 vertices so a bitmap word is never
+// shared by two sockets. Every socket-owned array is first touched by the
+// threads of its socket, which places its pages there.
+class SocketPartitionedGraph {
+  struct Slice {
+    pvector<SGOffset> out_offsets, in_offsets;
+    pvector<NodeID> out_neighs, in_neighs;
+  };
+
+  int num_sockets_;
+  vector<int> thread_socket_;
+  vector<NodeID> bounds_;
+  vector<Slice> slices_;
+  bool directed_;
+
+  static int CPUPackage(int cpu) {
+    char filename[256];
+    int package = 0;
+    sprintf(filename,
+            "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *f = fopen(filename, "r");
+    if (f != NULL) {
+      if (fscanf(f, "%d", &package) != 1)
+        package = 0;
+      fclose(f);
+    }
+    return package;
+  }
+
+  void DetectSockets() {
+    #ifdef _OPENMP
+    vector<int> thread_package(omp_get_max_threads());
+    #pragma omp parallel
+    thread_package[omp_get_thread_num()] = CPUPackage(sched_getcpu());
+    #else
+    vector<int> thread_package(1, 0);
+    #endif
+    vector<int> packages(thread_package);
+    sort(packages.begin(), packages.end());
+    packages.erase(unique(packages.begin(), packages.end()), packages.end());
+    num_sockets_ = packages.size();
+    for (int package : thread_package) {
+      thread_socket_.push_back(
+          lower_bound(packages.begin(), packages.end(), package) -
+          packages.begin());
+    }
+  }
+
+  void BalanceRanges(const Graph &g) {
+    int64_t total = g.num_nodes() + g.num_edges_directed() *
+                    (g.directed() ? 2 : 1);
+    bounds_.assign(num_sockets_ + 1, g.num_nodes());
+    bounds_[0] = 0;
+    int64_t cost = 0;
+    int s = 1;
+    for (NodeID n=0; n < g.num_nodes() && s < num_sockets_; n++) {
+      cost += 1 + g.out_degree(n) + (g.directed() ? g.in_degree(n) : 0);
+      if (cost * num_sockets_ >= total * s) {
+        bounds_[s] = min<int64_t>((n / 64 + 1) * 64, g.num_nodes());
+        n = bounds_[s] - 1;
+        s++;
+      }
+    }
+  }
+
+  // Runs body(n) for n in [lo, hi) on the threads of socket s only, which
+  // take chunks through a shared cursor (a worksharing loop would need the
+  // whole team)
+  template <typename BodyT>
+  void ForOnSocket(int s, NodeID lo, NodeID hi, BodyT body) {
+    const int64_t kChunk = 1024;
+    int64_t cursor = lo;
+    #pragma omp parallel
+    {
+      if (socket_of_thread() == s) {
+        while (true) {
+          int64_t c = fetch_and_add(cursor, kChunk);
+          if (c >= hi)
+            break;
+          for (NodeID n=c; n < min<int64_t>(c + kChunk, hi); n++)
+            body(n);
+        }
+      }
+    }
+  }
+
+  template <typename NeighFunc>
+  void CopyEdges(NeighFunc neigh, pvector<SGOffset> &offsets,
+                 pvector<NodeID> &neighs, int s) {
+    NodeID lo = begin(s), hi = end(s);
+    offsets = pvector<SGOffset>(hi - lo + 1);
+    offsets[0] = 0;
+    ForOnSocket(s, lo, hi, [&] (NodeID n) {
+      offsets[n - lo + 1] = neigh(n).end() - neigh(lo).begin();
+    });
+    neighs = pvector<NodeID>(offsets[hi - lo]);
+    ForOnSocket(s, lo, hi, [&] (NodeID n) {
+      copy(neigh(n).begin(), neigh(n).end(), neighs.begin() + offsets[n - lo]);
+    });
+  }
+
+ public:
+  explicit SocketPartitionedGraph(const Graph &g) : directed_(g.directed()) {
+    DetectSockets();
+    BalanceRanges(g);
+    slices_.resize(num_sockets_);
+    for (int s=0; s < num_sockets_; s++) {
+      Slice &sl = slices_[s];
+      CopyEdges([&g] (NodeID n) { return g.out_neigh(n); }, sl.out_offsets,
+                sl.out_neighs, s);
+      if (directed_) {
+        CopyEdges([&g] (NodeID n) { return g.in_neigh(n); }, sl.in_offsets,
+                  sl.in_neighs, s);
+      }
+    }
+    cout << "Partitioned across " << num_sockets_ << " socket(s)" << endl;
+  }
+
+  int num_sockets() const { return num_sockets_; }
+  NodeID begin(int s) const { return bounds_[s]; }
+  NodeID end(int s) const { return bounds_[s+1]; }
+
+  int socket_of_thread() const {
+    #ifdef _OPENMP
+    return thread_socket_[omp_get_thread_num()];
+    #else
+    return 0;
+    #endif
+  }
+
+  int socket_of(NodeID v) const {
+    int s = 0;
+    while (v >= bounds_[s+1])
+      s++;
+    return s;
+  }
+
+  pair<const NodeID*, const NodeID*> out_neigh(NodeID v, int s) const {
+    const Slice &sl = slices_[s];
+    return make_pair(sl.out_neighs.begin() + sl.out_offsets[v - begin(s)],
+                     sl.out_neighs.begin() + sl.out_offsets[v - begin(s) + 1]);
+  }
+
+  pair<const NodeID*, const NodeID*> in_neigh(NodeID v, int s) const {
+    if (!directed_)
+      return out_neigh(v, s);
+    const Slice &sl = slices_[s];
+    return make_pair(sl.in_neighs.begin() + sl.in_offsets[v - begin(s)],
+                     sl.in_neighs.begin() + sl.in_offsets[v - begin(s) + 1]);
+  }
+};
+
+
+// Per-trial state of the partitioned engine: socket-owned parent ranges, one
+// queue per socket, and replicated bitmaps. Work within a socket is handed
+// out in chunks through a per-socket cursor (padded to its own cache line).
+class PartitionedBFS {
+  static const int64_t kChunk = 1024;
+  static const int kCursorStride = 8;
+
+  const SocketPartitionedGraph &pg_;
+  const Graph &g_;
+  const int num_sockets_;
+  pvector<int64_t> cursors_;
+  vector<unique_ptr<SlidingQueue<NodeID>>> queues_;
+  vector<pvector<uint64_t>> front_, next_;
+  const int64_t num_words_;
+
+  void ResetCursors() {
+    for (int s=0; s < num_sockets_; s++)
+      cursors_[s * kCursorStride] = 0;
+  }
+
+  // Runs body(lo, hi) on chunks of [0, count) for the calling thread's socket
+  template <typename BodyT>
+  void SocketFor(int s, int64_t count, int64_t chunk, BodyT body) {
+    while (true) {
+      int64_t lo = fetch_and_add(cursors_[s * kCursorStride], chunk);
+      if (lo >= count)
+        break;
+      body(lo, min(lo + chunk, count));
+    }
+  }
+
+  // Bitmap words of socket s's range, none if BalanceRanges left it empty
+  // (its begin is then num_nodes, which need not be word-aligned)
+  int64_t FirstWord(int s) const { return pg_.begin(s) / 64; }
+  int64_t NumWords(int s) const {
+    if (pg_.begin(s) == pg_.end(s))
+      return 0;
+    return (pg_.end(s) + 63) / 64 - FirstWord(s);
+  }
+
+  // Copies the words each socket wrote for its own range to every replica
+  void MergeBitmaps(vector<pvector<uint64_t>> &bm) {
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int t = pg_.socket_of_thread();
+      SocketFor(t, num_words_, kChunk, [&] (int64_t lo, int64_t hi) {
+        for (int64_t w=lo; w < hi; w++) {
+          int owner = pg_.socket_of(w * 64);
+          if (owner != t)
+            bm[t][w] = bm[owner][w];
+        }
+      });
+    }
+  }
+
+ public:
+  PartitionedBFS(const SocketPartitionedGraph &pg, const Graph &g) :
+      pg_(pg), g_(g), num_sockets_(pg.num_sockets()),
+      cursors_(pg.num_sockets() * kCursorStride),
+      num_words_((g.num_nodes() + 63) / 64) {
+    for (int s=0; s < num_sockets_; s++) {
+      queues_.emplace_back(new SlidingQueue<NodeID>(pg.end(s) - pg.begin(s)));
+      front_.emplace_back(num_words_);
+      next_.emplace_back(num_words_);
+    }
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int s = pg_.socket_of_thread();
+      SocketFor(s, num_words_, kChunk, [&] (int64_t lo, int64_t hi) {
+        for (int64_t w=lo; w < hi; w++)
+          front_[s][w] = next_[s][w] = 0;
+      });
+    }
+  }
+
+  void InitParent(pvector<NodeID> &parent) {
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int s = pg_.socket_of_thread();
+      NodeID base = pg_.begin(s);
+      SocketFor(s, pg_.end(s) - base, kChunk, [&] (int64_t lo, int64_t hi) {
+        for (NodeID n=base+lo; n < base+hi; n++)
+          parent[n] = g_.out_degree(n) != 0 ? -g_.out_degree(n) : -1;
+      });
+    }
+  }
+
+  void PushSource(NodeID source) {
+    queues_[pg_.socket_of(source)]->push_back(source);
+    for (auto &q : queues_)
+      q->slide_window();
+  }
+
+  int64_t QueueSize() const {
+    int64_t size = 0;
+    for (auto &q : queues_)
+      size += q->size();
+    return size;
+  }
+
+  int64_t TDStep(pvector<NodeID> &parent) {
+    int64_t scout_count = 0;
+    ResetCursors();
+    #pragma omp parallel reduction(+ : scout_count)
+    {
+      int s = pg_.socket_of_thread();
+      vector<unique_ptr<QueueBuffer<NodeID>>> lqueues;
+      for (int t=0; t < num_sockets_; t++)
+        lqueues.emplace_back(new QueueBuffer<NodeID>(*queues_[t]));
+      const NodeID *items = queues_[s]->begin();
+      SocketFor(s, queues_[s]->size(), 64, [&] (int64_t lo, int64_t hi) {
+        for (int64_t i=lo; i < hi; i++) {
+          NodeID u = items[i];
+          auto neigh = pg_.out_neigh(u, s);
+          for (const NodeID *it = neigh.first; it < neigh.second; it++) {
+            NodeID v = *it;
+            NodeID curr_val = parent[v];
+            if (curr_val < 0) {
+              if (compare_and_swap(parent[v], curr_val, u)) {
+                lqueues[pg_.socket_of(v)]->push_back(v);
+                scout_count += -curr_val;
+              }
+            }
+          }
+        }
+      });
+      for (auto &lq : lqueues)
+        lq->flush();
+    }
+    for (auto &q : queues_)
+      q->slide_window();
+    return scout_count;
+  }
+
+  // Each thread builds whole words of its socket's range, so no atomics are
+  // needed. For the tuner it counts the in-edges examined and the in-edges of
+  // the unvisited vertices (what a full scan would have examined).
+  int64_t BUStep(pvector<NodeID> &parent, int64_t &edges_checked,
+                 int64_t &edges_unexplored) {
+    int64_t awake_count = 0, checked = 0, unexplored = 0;
+    ResetCursors();
+    #pragma omp parallel reduction(+ : awake_count, checked, unexplored)
+    {
+      int s = pg_.socket_of_thread();
+      const uint64_t *front = front_[s].begin();
+      uint64_t *next = next_[s].begin();
+      int64_t first_word = FirstWord(s);
+      SocketFor(s, NumWords(s), 16, [&] (int64_t lo, int64_t hi) {
+        for (int64_t w=first_word+lo; w < first_word+hi; w++) {
+          uint64_t bits = 0;
+          NodeID w_end = min<int64_t>((w + 1) * 64, pg_.end(s));
+          for (NodeID u=w*64; u < w_end; u++) {
+            if (parent[u] < 0) {
+              auto neigh = pg_.in_neigh(u, s);
+              unexplored += neigh.second - neigh.first;
+              for (const NodeID *it = neigh.first; it < neigh.second; it++) {
+                NodeID v = *it;
+                checked++;
+                if ((front[v / 64] >> (v % 64)) & 1) {
+                  parent[u] = v;
+                  awake_count++;
+                  bits |= 1ul << (u % 64);
+                  break;
+                }
+              }
+            }
+          }
+          next[w] = bits;
+        }
+      });
+    }
+    MergeBitmaps(next_);
+    front_.swap(next_);
+    edges_checked = checked;
+    edges_unexplored = unexplored;
+    return awake_count;
+  }
+
+  void QueueToBitmap() {
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int s = pg_.socket_of_thread();
+      uint64_t *front = front_[s].begin();
+      int64_t first_word = FirstWord(s);
+      SocketFor(s, NumWords(s), kChunk,
+                [&] (int64_t lo, int64_t hi) {
+        fill(front + first_word + lo, front + first_word + hi, 0);
+      });
+    }
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int s = pg_.socket_of_thread();
+      uint64_t *front = front_[s].begin();
+      const NodeID *items = queues_[s]->begin();
+      SocketFor(s, queues_[s]->size(), kChunk, [&] (int64_t lo, int64_t hi) {
+        for (int64_t i=lo; i < hi; i++)
+          __sync_fetch_and_or(&front[items[i] / 64], 1ul << (items[i] % 64));
+      });
+    }
+    MergeBitmaps(front_);
+    for (auto &q : queues_)
+      q->slide_window();
+  }
+
+  void BitmapToQueue() {
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int s = pg_.socket_of_thread();
+      const uint64_t *front = front_[s].begin();
+      int64_t first_word = FirstWord(s);
+      QueueBuffer<NodeID> lqueue(*queues_[s]);
+      SocketFor(s, NumWords(s), kChunk,
+                [&] (int64_t lo, int64_t hi) {
+        for (int64_t w=first_word+lo; w < first_word+hi; w++) {
+          for (uint64_t bits = front[w]; bits != 0; bits &= bits - 1)
+            lqueue.push_back(w * 64 + __builtin_ctzl(bits));
+        }
+      });
+      lqueue.flush();
+    }
+    for (auto &q : queues_)
+      q->slide_window();
+  }
+
+  void FixUnreached(pvector<NodeID> &parent) {
+    ResetCursors();
+    #pragma omp parallel
+    {
+      int s = pg_.socket_of_thread();
+      NodeID base = pg_.begin(s);
+      SocketFor(s, pg_.end(s) - base, kChunk, [&] (int64_t lo, int64_t hi) {
+        for (NodeID n=base+lo; n < base+hi; n++)
+          if (parent[n] < -1)
+            parent[n] = -1;
+      });
+    }
+  }
+};
+
+
+// Same control flow as DOBFS, on the socket-partitioned structures, with
+// alpha and beta taken from the tuner and every level metered to feed it
+pvector<NodeID> PartitionedDOBFS(const SocketPartitionedGraph &pg,
+                                 const Graph &g, NodeID source,
+                                 DirectionTuner &tuner) {
+  const int alpha = tuner.Alpha(15);
+  PartitionedBFS bfs(pg, g);
+  pvector<NodeID> parent(g.num_nodes());
+  bfs.InitParent(parent);
+  parent[source] = source;
+  bfs.PushSource(source);
+  int64_t edges_to_check = g.num_edges_directed();
+  int64_t scout_count = g.out_degree(source);
+  int beta = 18;
+  rapl_snapshot before, after;
+  while (bfs.QueueSize() != 0) {
+    if (scout_count > edges_to_check / alpha) {
+      int64_t awake_count, old_awake_count, bu_edges, unexplored;
+      bfs.QueueToBitmap();
+      awake_count = bfs.QueueSize();
+      do {
+        old_awake_count = awake_count;
+        read_rapl_snapshot(&before);
+        awake_count = bfs.BUStep(parent, bu_edges, unexplored);
+        read_rapl_snapshot(&after);
+        tuner.RecordBottomUp(rapl_snapshot_energy(&before, &after), bu_edges,
+                             unexplored);
+        beta = tuner.Beta(beta, g, bu_edges);
+      } while ((awake_count >= old_awake_count) ||
+               (awake_count > g.num_nodes() / beta));
+      bfs.BitmapToQueue();
+      scout_count = 1;
+    } else {
+      edges_to_check -= scout_count;
+      int64_t td_edges = scout_count;
+      read_rapl_snapshot(&before);
+      scout_count = bfs.TDStep(parent);
+      read_rapl_snapshot(&after);
+      tuner.RecordTopDown(rapl_snapshot_energy(&before, &after), td_edges);
+    }
+  }
+  bfs.FixUnreached(parent);
+  PrintStep("alpha", static_cast<int64_t>(alpha));
+  PrintStep("beta", static_cast<int64_t>(beta));
+  return parent;
+}
+
 
 void PrintBFSStats(const Graph &g, const pvector<NodeID> &bfs_tree) {
   int64_t tree_size = 0;
@@ -243,13 +783,21 @@ bool BFSVerifier(const Graph &g, NodeID source,
 
 
 int main(int argc, char* argv[]) {
-  CLApp cli(argc, argv, "breadth-first search");
+  CLBFSApp cli(argc, argv, "breadth-first search");
   if (!cli.ParseArgs())
     return -1;
-  Builder b(cli);
-  Graph g = b.MakeGraph();
+  Loader loader(cli);
+  const Graph &g = loader.graph();
   SourcePicker<Graph> sp(g, cli.start_vertex());
-  auto BFSBound = [&sp] (const Graph &g) { return DOBFS(g, sp.PickNext()); };
+  unique_ptr<SocketPartitionedGraph> pg;
+  if (cli.partitioned())
+    pg.reset(new SocketPartitionedGraph(g));
+  DirectionTuner tuner;
+  auto BFSBound = [&sp, &pg, &tuner] (const Graph &g) {
+    if (pg)
+      return PartitionedDOBFS(*pg, g, sp.PickNext(), tuner);
+    return DOBFS(g, sp.PickNext());
+  };
   SourcePicker<Graph> vsp(g, cli.start_vertex());
   auto VerifierBound = [&vsp] (const Graph &g, const pvector<NodeID> &parent) {
     return BFSVerifier(g, vsp.PickNext(), parent);
@@ -3,8 +3,10 @@
 
 #include <algorithm>
 #include <cinttypes>
+#include <cstdio>
 #include <iostream>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "benchmark.h"
@@ -26,6 +28,14 @@ Will return comp array labelling each vertex with a connected component ID
 This CC implementation makes use of the Afforest subgraph sampling algorithm [1],
 which restructures and extends the Shiloach-Vishkin algorithm [2].
 
+The optional streaming mode (-b) inserts the edges in batches instead, as if
+the graph grew over time. The comp union-find forest is kept between batches:
+each batch only Links its own edges and compresses the paths of the vertices
+it touched, so its cost scales with the batch rather than with the graph.
+Only the batch insertions are timed and metered per batch; the batches are
+built before the trials. With -R, each prefix of batches is also run once
+through Afforest from scratch after the trials, for comparison.
+
 [1] Michael Sutton, Tal Ben-Nun, and Amnon Barak. "Optimizing Parallel
     Graph Connectivity Computation via Subgraph Sampling" Symposium on
     Parallel and Distributed Processing, IPDPS 2018.
@@ -38,6 +48,30 @@ which restructures and extends the Shiloach-Vishkin algorithm [2].
 using namespace std;
 
 
+class CLCCApp : public CLApp {
+  int num_batches_ = 0;
+  bool compare_recompute_ = false;
+
+ public:
+  CLCCApp(int argc, char** argv, std::string name) : CLApp(argc, argv, name) {
+    get_args_ += "b:R";
+    AddHelpLine('b', "b", "stream edges in as b insertion batches", "off");
+    AddHelpLine('R', "", "compare batches with Afforest recomputes (-b)");
+  }
+
+  void HandleArg(signed char opt, char* opt_arg) override {
+    switch (opt) {
+      case 'b': num_batches_ = atoi(opt_arg);          break;
+      case 'R': compare_recompute_ = true;               break;
+      default: CLApp::HandleArg(opt, opt_arg);
+    }
+  }
+
+  int num_batches() const { return num_batches_; }
+  bool compare_recompute() const { return compare_recompute_; }
+};
+
+
 // Place nodes u and v in same component of lower component ID
 void Link(NodeID u, NodeID v, pvector<NodeID>& comp) {
   NodeID p1 = comp[u];
@@ -148,6 +182,157 @@ pvector<NodeID> Afforest(const Graph &g, int32_t neighbor_rounds = 2) {
   return comp;
 }
 
+typedef pair<NodeID, NodeID> Edge;
+
+
+// Deterministic batch of an edge, independent of its direction
+int EdgeBatch(NodeID u, NodeID v, int num_batches) {
+  uint64_t x = (static_cast<uint64_t>(min(u, v)) << 32) | max(u, v);
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdul;
+  x ^= x >> 33;
+  return x % num_batches;
+}
+
+
+// Splits the edges of g into insertion batches (each undirected edge once)
+vector<vector<Edge>> MakeEdgeBatches(const Graph &g, int num_batches) {
+  vector<vector<Edge>> batches(num_batches);
+  #pragma omp parallel
+  {
+    vector<vector<Edge>> local(num_batches);
+    #pragma omp for schedule(dynamic, 16384) nowait
+    for (NodeID u = 0; u < g.num_nodes(); u++) {
+      for (NodeID v : g.out_neigh(u)) {
+        if (g.directed() || u < v)
+          local[EdgeBatch(u, v, num_batches)].push_back(make_pair(u, v));
+      }
+    }
+    #pragma omp critical
+    for (int b = 0; b < num_batches; b++)
+      batches[b].insert(batches[b].end(), local[b].begin(), local[b].end());
+  }
+  return batches;
+}
+
+
+// Union-find state kept across insertion batches
+class IncrementalCC {
+  pvector<NodeID> comp_;
+
+ public:
+  explicit IncrementalCC(const Graph &g) : comp_(g.num_nodes()) {
+    #pragma omp parallel for
+    for (NodeID n = 0; n < g.num_nodes(); n++)
+      comp_[n] = n;
+  }
+
+  // Links the batch's edges, then shortens only the paths it touched
+  void InsertBatch(const vector<Edge> &batch) {
+    #pragma omp parallel for schedule(dynamic, 16384)
+    for (size_t i = 0; i < batch.size(); i++)
+      Link(batch[i].first, batch[i].second, comp_);
+    #pragma omp parallel for schedule(dynamic, 16384)
+    for (size_t i = 0; i < batch.size(); i++) {
+      for (NodeID n : {batch[i].first, batch[i].second}) {
+        while (comp_[n] != comp_[comp_[n]])
+          comp_[n] = comp_[comp_[n]];
+      }
+    }
+  }
+
+  // Fully compresses the forest so every vertex holds its component ID
+  pvector<NodeID> Labels(const Graph &g) {
+    Compress(g, comp_);
+    return pvector<NodeID>(comp_.begin(), comp_.end());
+  }
+};
+
+
+pvector<NodeID> StreamingCC(const Graph &g,
+                            const vector<vector<Edge>> &batches) {
+  IncrementalCC icc(g);
+  Timer t;
+  rapl_snapshot before, after;
+  double total_seconds = 0, total_energy = 0;
+  for (size_t b = 0; b < batches.size(); b++) {
+    read_rapl_snapshot(&before);
+    t.Start();
+    icc.InsertBatch(batches[b]);
+    t.Stop();
+    read_rapl_snapshot(&after);
+    double energy = rapl_snapshot_energy(&before, &after);
+    total_seconds += t.Seconds();
+    total_energy += energy;
+    printf("Batch %3zu %10zu edges  incremental %10.5lf s %10.4f J\n", b,
+           batches[b].size(), t.Seconds(), energy);
+  }
+  printf("Batches total %10.5lf s %10.4f J\n", total_seconds, total_energy);
+  return icc.Labels(g);
+}
+
+
+// The neighbors of g (in or out) whose edges are in batches [0, last],
+// as a CSR index over a new neighbor array
+NodeID** PrefixIndex(const Graph &g, int last, int num_batches, bool in_graph,
+                     NodeID* &neighs) {
+  pvector<SGOffset> offsets(g.num_nodes() + 1);
+  #pragma omp parallel for schedule(dynamic, 16384)
+  for (NodeID u = 0; u < g.num_nodes(); u++) {
+    SGOffset degree = 0;
+    for (NodeID v : (in_graph ? g.in_neigh(u) : g.out_neigh(u)))
+      degree += EdgeBatch(u, v, num_batches) <= last;
+    offsets[u] = degree;
+  }
+  SGOffset total = 0;
+  for (NodeID n = 0; n < g.num_nodes(); n++) {
+    SGOffset degree = offsets[n];
+    offsets[n] = total;
+    total += degree;
+  }
+  offsets[g.num_nodes()] = total;
+  neighs = new NodeID[total];
+  #pragma omp parallel for schedule(dynamic, 16384)
+  for (NodeID u = 0; u < g.num_nodes(); u++) {
+    SGOffset pos = offsets[u];
+    for (NodeID v : (in_graph ? g.in_neigh(u) : g.out_neigh(u))) {
+      if (EdgeBatch(u, v, num_batches) <= last)
+        neighs[pos++] = v;
+    }
+  }
+  return Graph::GenIndex(offsets, neighs);
+}
+
+
+// The graph of the edges inserted in batches [0, last]
+Graph PrefixGraph(const Graph &g, int last, int num_batches) {
+  NodeID *out_neighs, *in_neighs;
+  NodeID **out_index = PrefixIndex(g, last, num_batches, false, out_neighs);
+  if (!g.directed())
+    return Graph(g.num_nodes(), out_index, out_neighs);
+  NodeID **in_index = PrefixIndex(g, last, num_batches, true, in_neighs);
+  return Graph(g.num_nodes(), out_index, out_neighs, in_index, in_neighs);
+}
+
+
+// From-scratch baseline for -R, outside the trials: Afforest over the graph
+// of each prefix of batches (building that graph is not timed)
+void CompareRecompute(const Graph &g, int num_batches) {
+  Timer t;
+  rapl_snapshot before, after;
+  for (int b = 0; b < num_batches; b++) {
+    Graph prefix = PrefixGraph(g, b, num_batches);
+    read_rapl_snapshot(&before);
+    t.Start();
+    Afforest(prefix);
+    t.Stop();
+    read_rapl_snapshot(&after);
+    printf("Batch %3d %10" PRId64 " edges  recompute %10.5lf s %10.4f J\n", b,
+           prefix.num_edges(), t.Seconds(),
+           rapl_snapshot_energy(&before, &after));
+  }
+}
+
 
 void PrintCompStats(const Graph &g, const pvector<NodeID> &comp) {
   cout << endl;
@@ -216,12 +401,21 @@ bool CCVerifier(const Graph &g, const pvector<NodeID> &comp) {
 
 
 int main(int argc, char* argv[]) {
-  CLApp cli(argc, argv, "connected-components-afforest");
+  CLCCApp cli(argc, argv, "connected-components-afforest");
   if (!cli.ParseArgs())
     return -1;
-  Builder b(cli);
-  Graph g = b.MakeGraph();
-  auto CCBound = [](const Graph& gr){ return Afforest(gr); };
+  Loader loader(cli);
+  const Graph &g = loader.graph();
+  vector<vector<Edge>> batches;
+  if (cli.num_batches() > 0)
+    batches = MakeEdgeBatches(g, cli.num_batches());
+  auto CCBound = [&batches] (const Graph& gr) {
+    if (!batches.empty())
+      return StreamingCC(gr, batches);
+    return Afforest(gr);
+  };
   BenchmarkKernel(cli, g, CCBound, PrintCompStats, CCVerifier);
+  if (cli.num_batches() > 0 && cli.compare_recompute())
+    CompareRecompute(g, cli.num_batches());
   return 0;
 }
@@ -0,0 +1,40 @@
+#include <iostream>
+
+#include "benchmark.h"
+#include "builder.h"
+#include "command_line.h"
+#include "graph.h"
+#include "mapped_graph.h"
+
+using namespace std;
+
+/*
+GAP Benchmark Suite
+Tool:   Mapped graph converter
+
+Builds a graph once and writes it as a .msg file that every kernel can then
+map in place with -f (see mapped_graph.h), skipping the build on each run.
+*/
+
+
+int main(int argc, char* argv[]) {
+  CLConvert cli(argc, argv, "mapped graph converter");
+  if (!cli.ParseArgs())
+    return -1;
+  if (!cli.out_sg() || !IsMappedGraphFile(cli.out_filename())) {
+    cout << "Use -b <file.msg> to name the mapped output" << endl;
+    return -1;
+  }
+  if (cli.out_weighted()) {
+    WeightedBuilder bw(cli);
+    WGraph wg = bw.MakeGraph();
+    wg.PrintStats();
+    WriteMappedGraph(wg, cli.out_filename());
+  } else {
+    Builder b(cli);
+    Graph g = b.MakeGraph();
+    g.PrintStats();
+    WriteMappedGraph(g, cli.out_filename());
+  }
+  return 0;
+}
@@ -0,0 +1,217 @@
+// Copyright (c) 2015, The Regents of the University of California (Regents)
+// See LICENSE.txt for license details
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "benchmark.h"
+#include "builder.h"
+#include "command_line.h"
+#include "graph.h"
+#include "pvector.h"
+#include "sliding_queue.h"
+#include "timer.h"
+
+/*
+GAP Benchmark Suite
+Kernel: PageRank (PR), delta/frontier variant
+
+Will return pagerank scores for all vertices once total change < epsilon
+
+Instead of recomputing every vertex every iteration, this variant keeps for
+each vertex the residual r = base + kDamp * (incoming contributions) - score,
+i.e. exactly the per-vertex error PRVerifier measures. Only vertices whose
+residual exceeds epsilon / (2n) are active: they fold their residual into
+their score and push kDamp * r / out_degree to their out-neighbors. Since all
+residuals are positive, once no vertex is active the total error is below
+epsilon. The frontier is processed by pushing along its out-edges while it is
+small, and by pulling over all in-edges once the edges leaving it exceed
+num_edges / kDenseFraction (the same switch Ligra's edgeMap uses). Each
+iteration reports its mode, active vertices, edges touched, time and energy.
+*/
+
+
+using namespace std;
+
+typedef float ScoreT;
+const float kDamp = 0.85;
+const int kDenseFraction = 20;
+
+
+// Atomically adds to a float and returns its previous value
+ScoreT AtomicAdd(ScoreT &x, ScoreT inc) {
+  union { ScoreT f; uint32_t bits; } old_val, new_val;
+  do {
+    old_val.f = x;
+    new_val.f = old_val.f + inc;
+  } while (!__sync_bool_compare_and_swap(reinterpret_cast<uint32_t*>(&x),
+                                         old_val.bits, new_val.bits));
+  return old_val.f;
+}
+
+
+// Push direction: the active vertices first fold in their residuals, then add
+// their contributions to their out-neighbors, queuing those that cross the
+// threshold. Residuals only grow while pushing, so each crosses at most once.
+int64_t SparseStep(const Graph &g, pvector<ScoreT> &scores,
+                   pvector<ScoreT> &residuals, pvector<ScoreT> &contrib,
+                   const SlidingQueue<NodeID> &queue,
+                   SlidingQueue<NodeID> &next, ScoreT threshold) {
+  #pragma omp parallel for
+  for (auto q_iter = queue.begin(); q_iter < queue.end(); q_iter++) {
+    NodeID u = *q_iter;
+    scores[u] += residuals[u];
+    contrib[u] = kDamp * residuals[u] / g.out_degree(u);
+    residuals[u] = 0;
+  }
+  int64_t edges_touched = 0;
+  #pragma omp parallel
+  {
+    QueueBuffer<NodeID> lqueue(next);
+    #pragma omp for reduction(+ : edges_touched) schedule(dynamic, 64) nowait
+    for (auto q_iter = queue.begin(); q_iter < queue.end(); q_iter++) {
+      NodeID u = *q_iter;
+      for (NodeID v : g.out_neigh(u)) {
+        ScoreT old_residual = AtomicAdd(residuals[v], contrib[u]);
+        if ((old_residual <= threshold) &&
+            (old_residual + contrib[u] > threshold))
+          lqueue.push_back(v);
+      }
+      edges_touched += g.out_degree(u);
+    }
+    lqueue.flush();
+  }
+  next.slide_window();
+  return edges_touched;
+}
+
+
+// Pull direction over every vertex, finding the next queue by scanning
+int64_t DenseStep(const Graph &g, pvector<ScoreT> &scores,
+                  pvector<ScoreT> &residuals, pvector<ScoreT> &contrib,
+                  SlidingQueue<NodeID> &next, ScoreT threshold) {
+  #pragma omp parallel for schedule(dynamic, 16384)
+  for (NodeID u=0; u < g.num_nodes(); u++) {
+    if (residuals[u] > threshold) {
+      scores[u] += residuals[u];
+      contrib[u] = kDamp * residuals[u] / g.out_degree(u);
+      residuals[u] = 0;
+    } else {
+      contrib[u] = 0;
+    }
+  }
+  #pragma omp parallel
+  {
+    QueueBuffer<NodeID> lqueue(next);
+    #pragma omp for schedule(dynamic, 16384) nowait
+    for (NodeID u=0; u < g.num_nodes(); u++) {
+      ScoreT incoming_total = 0;
+      for (NodeID v : g.in_neigh(u))
+        incoming_total += contrib[v];
+      residuals[u] += incoming_total;
+      if (residuals[u] > threshold)
+        lqueue.push_back(u);
+    }
+    lqueue.flush();
+  }
+  next.slide_window();
+  return g.num_edges_directed();
+}
+
+
+pvector<ScoreT> PageRankDelta(const Graph &g, int max_iters,
+                              double epsilon = 0) {
+  const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
+  const ScoreT threshold = epsilon / (2 * g.num_nodes());
+  pvector<ScoreT> scores(g.num_nodes(), 0);
+  pvector<ScoreT> residuals(g.num_nodes(), base_score);
+  pvector<ScoreT> contrib(g.num_nodes());
+  // A vertex enters the next queue at most once per iteration
+  SlidingQueue<NodeID> queue_a(g.num_nodes()), queue_b(g.num_nodes());
+  SlidingQueue<NodeID> *queue = &queue_a, *next = &queue_b;
+  for (NodeID n=0; n < g.num_nodes(); n++)
+    queue->push_back(n);
+  queue->slide_window();
+  Timer t;
+  rapl_snapshot before, after;
+  int64_t total_edges = 0;
+  int iter;
+  for (iter=0; iter < max_iters && !queue->empty(); iter++) {
+    int64_t active = queue->size();
+    int64_t frontier_edges = 0;
+    #pragma omp parallel for reduction(+ : frontier_edges)
+    for (auto q_iter = queue->begin(); q_iter < queue->end(); q_iter++)
+      frontier_edges += g.out_degree(*q_iter);
+    bool dense = frontier_edges > g.num_edges_directed() / kDenseFraction;
+    read_rapl_snapshot(&before);
+    t.Start();
+    int64_t edges_touched = dense ?
+        DenseStep(g, scores, residuals, contrib, *next, threshold) :
+        SparseStep(g, scores, residuals, contrib, *queue, *next, threshold);
+    t.Stop();
+    read_rapl_snapshot(&after);
+    queue->reset();
+    swap(queue, next);
+    total_edges += edges_touched;
+    printf(" %2d %6s %10" PRId64 " active %12" PRId64 " edges %10.5lf s"
+           " %10.4f J\n", iter, dense ? "dense" : "sparse", active,
+           edges_touched, t.Seconds(), rapl_snapshot_energy(&before, &after));
+  }
+  PrintStep("Iterations", static_cast<int64_t>(iter));
+  PrintStep("Edges touched", total_edges);
+  return scores;
+}
+
+
+void PrintTopScores(const Graph &g, const pvector<ScoreT> &scores) {
+  vector<pair<NodeID, ScoreT>> score_pairs(g.num_nodes());
+  for (NodeID n=0; n < g.num_nodes(); n++) {
+    score_pairs[n] = make_pair(n, scores[n]);
+  }
+  int k = 5;
+  vector<pair<ScoreT, NodeID>> top_k = TopK(score_pairs, k);
+  k = min(k, static_cast<int>(top_k.size()));
+  for (auto kvp : top_k)
+    cout << kvp.second << ":" << kvp.first << endl;
+}
+
+
+// Verifies by asserting a single serial iteration in push direction has
+//   error < target_error
+bool PRVerifier(const Graph &g, const pvector<ScoreT> &scores,
+                        double target_error) {
+  const ScoreT base_score = (1.0f - kDamp) / g.num_nodes();
+  pvector<ScoreT> incomming_sums(g.num_nodes(), 0);
+  double error = 0;
+  for (NodeID u : g.vertices()) {
+    ScoreT outgoing_contrib = scores[u] / g.out_degree(u);
+    for (NodeID v : g.out_neigh(u))
+      incomming_sums[v] += outgoing_contrib;
+  }
+  for (NodeID n : g.vertices()) {
+    error += fabs(base_score + kDamp * incomming_sums[n] - scores[n]);
+    incomming_sums[n] = 0;
+  }
+  PrintTime("Total Error", error);
+  return error < target_error;
+}
+
+
+int main(int argc, char* argv[]) {
+  CLPageRank cli(argc, argv, "pagerank-delta", 1e-4, 100);
+  if (!cli.ParseArgs())
+    return -1;
+  Loader loader(cli);
+  const Graph &g = loader.graph();
+  auto PRBound = [&cli] (const Graph &g) {
+    return PageRankDelta(g, cli.max_iters(), cli.tolerance());
+  };
+  auto VerifierBound = [&cli] (const Graph &g, const pvector<ScoreT> &scores) {
+    return PRVerifier(g, scores, cli.tolerance());
+  };
+  BenchmarkKernel(cli, g, PRBound, PrintTopScores, VerifierBound);
+  return 0;
+}
@@ -24,6 +24,12 @@ short int leituras = 0;
 /****** RAPL UTILS ******/
 void rapl_init()
 {
+  /* Safe to call more than once: packages must only be counted once */
+  static int initialized = 0;
+  if (initialized)
+    return;
+  initialized = 1;
+
   /*Initialization of RAPL */
   detect_cpu();
   detect_packages();
@@ -256,6 +262,53 @@ double end_rapl_parcial_reading(){
 
 
 
+/* Reads the counters of every valid domain without touching the state used
+   by start_rapl_sysfs()/end_rapl_sysfs(), so it can be nested inside them */
+void read_rapl_snapshot(struct rapl_snapshot *snap){
+        int i, j;
+        FILE *fff;
+        for(j=0;j<total_packages;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        snap->uj[j][i] = 0;
+                        if (valid[j][i]) {
+                                fff=fopen(filenames[j][i],"r");
+                                if (fff==NULL) {
+                                        fprintf(stderr,"\tError opening %s!\n",filenames[j][i]);
+                                }
+                                else {
+                                        fscanf(fff,"%lld",&snap->uj[j][i]);
+                                        fclose(fff);
+                                }
+                        }
+                }
+        }
+}
+
+/* Energy (J) between two snapshots, summing the same domains as
+   end_rapl_sysfs(). Only one wrap-around per domain can be detected, so
+   snapshots should be taken less than PERIODO seconds apart */
+double rapl_snapshot_energy(const struct rapl_snapshot *before,
+                            const struct rapl_snapshot *after){
+        int i, j;
+        double total=0;
+        for(j=0;j<total_packages;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        if(valid[j][i]){
+                                if(strcmp(event_names[j][i],"core")!=0 && strcmp(event_names[j][i],"uncore")!=0){
+                                        double b = (double)before->uj[j][i];
+                                        double a = (double)after->uj[j][i];
+                                        if(b <= a){
+                                                total += ((a-b)/1000000.0);
+                                        }else{
+                                                total += (((max_energy_range_uj-b)+ a)/1000000.0);
+                                        }
+                                }
+                        }
+                }
+        }
+        return total;
+}
+
 void ALARMhandler(int sig) {
     if(read_count_energy){
                 int i, j;
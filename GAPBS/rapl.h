@@ -56,3 +56,11 @@ double end_rapl_sysfs(void);
 void ALARMhandler(int);
 double end_rapl_parcial_reading();
 /*---------------------------*/
+
+/* Counter snapshots that do not disturb an ongoing start/end measurement */
+struct rapl_snapshot {
+        long long uj[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+};
+void read_rapl_snapshot(struct rapl_snapshot *snap);
+double rapl_snapshot_energy(const struct rapl_snapshot *before,
+                            const struct rapl_snapshot *after);
@@ -189,8 +189,8 @@ int main(int argc, char* argv[]) {
   CLDelta<WeightT> cli(argc, argv, "single-source shortest-path");
   if (!cli.ParseArgs())
     return -1;
-  WeightedBuilder b(cli);
-  WGraph g = b.MakeGraph();
+  WeightedLoader loader(cli);
+  const WGraph &g = loader.graph();
   SourcePicker<WGraph> sp(g, cli.start_vertex());
   auto SSSPBound = [&sp, &cli] (const WGraph &g) {
     return DeltaStep(g, sp.PickNext(), cli.delta());
@@ -132,8 +132,8 @@ int main(int argc, char* argv[]) {
   CLApp cli(argc, argv, "triangle count");
   if (!cli.ParseArgs())
     return -1;
-  Builder b(cli);
-  Graph g = b.MakeGraph();
+  Loader loader(cli);
+  const Graph &g = loader.graph();
   if (g.directed()) {
     cout << "Input graph is directed but tc requires undirected" << endl;
     return -2;
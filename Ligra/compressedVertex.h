@@ -0,0 +1,9 @@
+// The compressed vertices of the code the binary is built with. Builds
+// with STREAMVBYTE get the Stream-VByte vertices of streamVByteVertex.h.
+// Every other build gets upstream's compressedVertex.h, which is the file
+// the Makefile would link here, with its byte, nibble or byteRLE code.
+#ifdef STREAMVBYTE
+#include "streamVByteVertex.h"
+#else
+#include "../ligra/compressedVertex.h"
+#endif
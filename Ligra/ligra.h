@@ -29,6 +29,8 @@
 #include <cstring>
 #include <string>
 #include <algorithm>
+#include <utility>
+#include <vector>
 #include "parallel.h"
 #include "gettime.h"
 #include "utils.h"
@@ -40,6 +42,11 @@
 #include "parseCommandLine.h"
 #include "index_map.h"
 #include "edgeMap_utils.h"
+#ifdef NUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#endif
 
 // Hiago MGA Rocha (14/21/2021)
 #include "rapl.h"
@@ -48,6 +55,264 @@ using namespace std;
 
 //*****START FRAMEWORK*****
 
+//*****TRANSPOSE VIEWS*****
+
+// An asymmetric graph already holds its in- and out-edges, but
+// graph::transpose() swaps them vertex by vertex, an O(n) pass over the
+// vertex array that multi-round runs paid once in the application and
+// once more to restore the graph after every round. Instead, both
+// orientations of the vertex array are kept (they share the edge arrays)
+// and transpose() swaps the graph between them in O(1). The transposed
+// view is built the first time it is needed, or up front by
+// buildTransposeView. Vertex data changed in place (packEdges) is only
+// seen in the view that was changed.
+template <class vertex>
+vector<pair<vertex*, vertex*>>& transposeViews() {
+  static vector<pair<vertex*, vertex*>> views;
+  return views;
+}
+
+template <class vertex>
+vertex* transposeView(vertex* V, long n) {
+  for (auto& p : transposeViews<vertex>()) {
+    if (p.first == V) return p.second;
+    if (p.second == V) return p.first;
+  }
+  vertex* flipped = newA(vertex, n);
+  parallel_for(long i=0;i<n;i++) {
+    flipped[i] = V[i];
+    flipped[i].flipEdges();
+  }
+  transposeViews<vertex>().push_back(make_pair(V, flipped));
+  return flipped;
+}
+
+template <class vertex>
+void buildTransposeView(graph<vertex>& GA) { transposeView(GA.V, GA.n); }
+
+// Frees the views built for GA; call before GA.del()
+template <class vertex>
+void delTransposeView(graph<vertex>& GA) {
+  auto& views = transposeViews<vertex>();
+  for (size_t i=0; i<views.size(); i++) {
+    if (views[i].first != GA.V && views[i].second != GA.V) continue;
+    if (GA.transposed) GA.transpose();
+    free(views[i].second);
+    views.erase(views.begin() + i);
+    return;
+  }
+}
+
+template <>
+inline void graph<asymmetricVertex>::transpose() {
+  V = transposeView(V, n);
+  transposed = !transposed;
+}
+
+template <>
+inline void graph<compressedAsymmetricVertex>::transpose() {
+  V = transposeView(V, n);
+  transposed = !transposed;
+}
+
+//*****NUMA PLACEMENT*****
+
+// -numa interleave|partition|replicate (build with NUMA=1) chooses where the
+// graph lives instead of wherever the loader's threads first touched it:
+//  interleave: every allocation of the run, including the graph and the
+//              vertexSubset buffers, is interleaved page by page over all
+//              nodes (set before the graph is read).
+//  partition:  the vertex array and the edge arrays are split into equal
+//              vertex ranges, range k moved to node k. vertexSubset buffers
+//              are first touched by the parallel loops that clear them,
+//              which splits them the same way when threads are bound.
+//  replicate:  the vertex array (degrees and edge offsets, read-only while
+//              edgeMap runs) is copied to every node and edgeMap reads the
+//              copy of the node it runs on; the edges are interleaved.
+// Existing pages are moved with mbind(MPOL_MF_MOVE). With a placement set,
+// every round also reports package and DRAM energy per socket.
+enum placementMode { place_default, place_interleave, place_partition,
+                     place_replicate };
+placementMode placement = place_default;
+long replicaGeneration = 0;
+
+template <class vertex>
+struct vertexReplica {
+  vertex* V;
+  long n;
+  vector<vertex*> copies; //one per node
+};
+
+template <class vertex>
+vector<vertexReplica<vertex>>& vertexReplicas() {
+  static vector<vertexReplica<vertex>> replicas;
+  return replicas;
+}
+
+#ifdef NUMA
+inline int threadNode() {
+  static thread_local int node = -1;
+  if (node < 0) node = max(0, numa_node_of_cpu(sched_getcpu()));
+  return node;
+}
+
+// Moves the pages overlapping [start, end) under the given policy
+inline bool movePages(uintptr_t start, uintptr_t end, int mode,
+                      unsigned long nodemask) {
+  const uintptr_t page = 4096;
+  start &= ~(page - 1);
+  end = (end + page - 1) & ~(page - 1);
+  if (end <= start) return true;
+  return mbind((void*) start, end - start, mode, &nodemask,
+               8 * sizeof(nodemask), MPOL_MF_MOVE) == 0;
+}
+
+// Bytes of the out-edges of a vertex, by the type of its neighbor array.
+// A compressed list (-c) does not know its length, so compressed edges are
+// never placed (placesEdges) and their edgeBytes is unused.
+template <class vertex>
+inline uintptr_t edgeBytes(vertex& v, uintE*) { return v.getOutDegree() * sizeof(uintE); }
+template <class vertex>
+inline uintptr_t edgeBytes(vertex& v, intE*) { return 2 * v.getOutDegree() * sizeof(intE); }
+template <class vertex>
+inline uintptr_t edgeBytes(vertex& v, unsigned char*) { return 0; }
+inline bool placesEdges(uintE*) { return true; }
+inline bool placesEdges(intE*) { return true; }
+inline bool placesEdges(unsigned char*) { return false; }
+
+// Splits an array laid out in vertex order over the nodes; at(i) is the
+// address of vertex i's data and at(n) the end of the array
+template <class A>
+bool partitionPages(long n, int nodes, A at) {
+  bool ok = true;
+  for (int k=0; k<nodes; k++) {
+    uintptr_t lo = at(n * k / nodes), hi = at(n * (k+1) / nodes);
+    // a page shared by two ranges goes to the lower one: its end is rounded
+    // up past that page, and the start of the next range is rounded up too
+    if (k > 0) lo = (lo + 4095) & ~(uintptr_t) 4095;
+    if (k+1 < nodes) hi = (hi + 4095) & ~(uintptr_t) 4095;
+    ok &= movePages(lo, hi, MPOL_BIND, 1UL << k);
+  }
+  return ok;
+}
+
+template <class vertex>
+bool partitionVertices(vertex* V, long n, int nodes, bool symmetric) {
+  typedef decltype(V[0].getOutNeighbors()) E;
+  bool ok = partitionPages(n, nodes, [&] (long i) {
+    return (uintptr_t) (V + i); });
+  if (n == 0) return ok;
+  bool edges = placesEdges((E) NULL);
+  if (edges) ok &= partitionPages(n, nodes, [&] (long i) {
+    return i < n ? (uintptr_t) V[i].getOutNeighbors() :
+      (uintptr_t) V[n-1].getOutNeighbors() + edgeBytes(V[n-1], (E) NULL); });
+  if (!symmetric) {
+    // same layout for the in-edges; the flipped view has them as out-edges
+    vertex* T = transposeView(V, n);
+    if (edges) ok &= partitionPages(n, nodes, [&] (long i) {
+      return i < n ? (uintptr_t) T[i].getOutNeighbors() :
+        (uintptr_t) T[n-1].getOutNeighbors() + edgeBytes(T[n-1], (E) NULL); });
+    ok &= partitionPages(n, nodes, [&] (long i) {
+      return (uintptr_t) (T + i); });
+  }
+  return ok;
+}
+
+template <class vertex>
+void replicateVertices(vertex* V, long n, int nodes) {
+  vector<vertex*> copies(nodes);
+  for (int k=0; k<nodes; k++) {
+    copies[k] = (vertex*) numa_alloc_onnode(n * sizeof(vertex), k);
+    memcpy(copies[k], V, n * sizeof(vertex));
+  }
+  vertexReplicas<vertex>().push_back({V, n, copies});
+}
+#endif
+
+// The copy of V on the calling thread's node (V itself unless replicated)
+template <class vertex>
+inline vertex* localVertices(vertex* V) {
+#ifdef NUMA
+  if (placement != place_replicate) return V;
+  static thread_local vertex* lastV = NULL;
+  static thread_local vertex* lastLocal = NULL;
+  static thread_local long lastGeneration = -1;
+  if (V != lastV || lastGeneration != replicaGeneration) {
+    lastV = lastLocal = V;
+    lastGeneration = replicaGeneration;
+    for (auto& r : vertexReplicas<vertex>())
+      if (r.V == V) lastLocal = r.copies[threadNode()];
+  }
+  return lastLocal;
+#else
+  return V;
+#endif
+}
+
+// Replicas are read-only copies; call before changing vertices in place
+template <class vertex>
+void dropVertexReplicas() {
+#ifdef NUMA
+  for (auto& r : vertexReplicas<vertex>())
+    for (vertex* copy : r.copies) numa_free(copy, r.n * sizeof(vertex));
+#endif
+  vertexReplicas<vertex>().clear();
+  replicaGeneration++;
+}
+
+// Sets the policy for allocations made from now on; call before reading
+inline void setPlacement(char* mode) {
+  if (!mode) return;
+  if (!strcmp(mode, "interleave")) placement = place_interleave;
+  else if (!strcmp(mode, "partition")) placement = place_partition;
+  else if (!strcmp(mode, "replicate")) placement = place_replicate;
+  else {
+    cout << "Unknown -numa mode " << mode << endl;
+    abort();
+  }
+#ifdef NUMA
+  if (numa_available() < 0) {
+    cout << "NUMA not available, ignoring -numa" << endl;
+    placement = place_default;
+  } else if (placement == place_interleave) {
+    numa_set_interleave_mask(numa_all_nodes_ptr);
+  }
+#else
+  cout << "Built without NUMA=1, ignoring -numa" << endl;
+  placement = place_default;
+#endif
+}
+
+// Places a freshly read graph (and its transpose view) under the policy
+template <class vertex>
+void placeGraph(graph<vertex>& GA, bool symmetric) {
+#ifdef NUMA
+  if (placement != place_partition && placement != place_replicate) return;
+  typedef decltype(GA.V[0].getOutNeighbors()) E;
+  int nodes = numa_num_configured_nodes();
+  bool ok = true;
+  if (placement == place_partition) {
+    ok = partitionVertices(GA.V, GA.n, nodes, symmetric);
+  } else {
+    unsigned long all = (nodes >= 64) ? ~0UL : (1UL << nodes) - 1;
+    vertex* views[2] = {GA.V, symmetric ? NULL : transposeView(GA.V, GA.n)};
+    for (vertex* V : views) {
+      if (!V || GA.n == 0) continue;
+      if (placesEdges((E) NULL))
+        ok &= movePages((uintptr_t) V[0].getOutNeighbors(),
+                        (uintptr_t) V[GA.n-1].getOutNeighbors() +
+                        edgeBytes(V[GA.n-1], (E) NULL), MPOL_INTERLEAVE, all);
+      replicateVertices(V, GA.n, nodes);
+    }
+    replicaGeneration++;
+  }
+  printf("NUMA placement : %s over %d nodes%s%s\n",
+         placement == place_partition ? "partition" : "replicate", nodes,
+         placesEdges((E) NULL) ? "" : ", compressed edges left in place",
+         ok ? "" : " (some pages could not be moved)");
+#endif
+}
+
 typedef uint32_t flags;
 const flags no_output = 1;
 const flags pack_edges = 2;
@@ -59,6 +324,10 @@ const flags no_dense = 64;
 const flags edge_parallel = 128;
 inline bool should_output(const flags& fl) { return !(fl & no_output); }
 
+// Edges scanned by edgeMap since the last reset (all of them for a dense
+// pass, the frontier's out-edges otherwise), used for energy per edge
+long edgesTraversed = 0;
+
 template <class data, class vertex, class VS, class F>
 vertexSubsetData<data> edgeMapDense(graph<vertex> GA, VS& vertexSubset, F &f, const flags fl) {
   using D = tuple<bool, data>;
@@ -70,7 +339,7 @@ vertexSubsetData<data> edgeMapDense(graph<vertex> GA, VS& vertexSubset, F &f, co
     parallel_for (long v=0; v<n; v++) {
       std::get<0>(next[v]) = 0;
       if (f.cond(v)) {
-        G[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
+        localVertices(G)[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
       }
     }
     return vertexSubsetData<data>(n, next);
@@ -78,7 +347,7 @@ vertexSubsetData<data> edgeMapDense(graph<vertex> GA, VS& vertexSubset, F &f, co
     auto g = get_emdense_nooutput_gen<data>();
     parallel_for (long v=0; v<n; v++) {
       if (f.cond(v)) {
-        G[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
+        localVertices(G)[v].decodeInNghBreakEarly(v, vertexSubset, f, g, fl & dense_parallel);
       }
     }
     return vertexSubsetData<data>(n);
@@ -96,7 +365,7 @@ vertexSubsetData<data> edgeMapDenseForward(graph<vertex> GA, VS& vertexSubset, F
     parallel_for(long i=0;i<n;i++) { std::get<0>(next[i]) = 0; }
     parallel_for (long i=0; i<n; i++) {
       if (vertexSubset.isIn(i)) {
-        G[i].decodeOutNgh(i, f, g);
+        localVertices(G)[i].decodeOutNgh(i, f, g);
       }
     }
     return vertexSubsetData<data>(n, next);
@@ -104,7 +373,7 @@ vertexSubsetData<data> edgeMapDenseForward(graph<vertex> GA, VS& vertexSubset, F
     auto g = get_emdense_forward_nooutput_gen<data>();
     parallel_for (long i=0; i<n; i++) {
       if (vertexSubset.isIn(i)) {
-        G[i].decodeOutNgh(i, f, g);
+        localVertices(G)[i].decodeOutNgh(i, f, g);
       }
     }
     return vertexSubsetData<data>(n);
@@ -234,11 +503,139 @@ vertexSubsetData<data> edgeMapSparse_no_filter(graph<vertex>& GA,
   return vertexSubsetData<data>(n, outSize, out);
 }
 
+//*****ADAPTIVE DENSE/SPARSE SWITCH*****
+
+// With -adapt time|energy, edgeMapData learns online what an edge costs in
+// each mode (seconds or joules per unit of work below) and picks the cheaper
+// mode for each call instead of using the fixed threshold. Until the chosen
+// dense variant and the sparse mode have both been seen, the fixed threshold
+// decides, which is what produces the first samples. The state lives for
+// the whole run, so it is learned per graph and application during the
+// warmup and keeps refining over the rounds. -adapttrace prints each call.
+enum edgeMapMode { em_sparse, em_dense, em_dense_forward, em_modes };
+const char* edgeMapModeNames[em_modes] = {"sparse", "dense", "dense-forward"};
+
+struct densityPolicy {
+  bool adaptive = false, energy = false, trace = false;
+  double cost[em_modes] = {}, work[em_modes] = {};
+  long choices[em_modes] = {};
+
+  // Work of a call in each mode: sparse touches the frontier and its
+  // out-edges, dense pull visits every vertex and (at most) all in-edges,
+  // dense forward visits every vertex and the frontier's out-edges.
+  static double modeWork(edgeMapMode mode, long n, long numEdges, long m,
+                         long outDegrees) {
+    if (mode == em_sparse) return m + outDegrees;
+    if (mode == em_dense) return n + numEdges;
+    return n + outDegrees;
+  }
+  // energy stays 0 until a call spans a RAPL counter update
+  bool learned(edgeMapMode mode) { return work[mode] > 0 && cost[mode] > 0; }
+  double predict(edgeMapMode mode, double w) {
+    return cost[mode] / work[mode] * w;
+  }
+
+  bool chooseDense(edgeMapMode denseMode, bool fixedDense, long n,
+                   long numEdges, long m, long outDegrees) {
+    bool dense = fixedDense;
+    double ws = modeWork(em_sparse, n, numEdges, m, outDegrees);
+    double wd = modeWork(denseMode, n, numEdges, m, outDegrees);
+    if (learned(em_sparse) && learned(denseMode))
+      dense = predict(denseMode, wd) < predict(em_sparse, ws);
+    if (trace) {
+      printf("adapt: frontier %ld out-degrees %ld", m, outDegrees);
+      if (learned(em_sparse) && learned(denseMode)) {
+        printf(" predicted sparse %.3g %s %.3g", predict(em_sparse, ws),
+               edgeMapModeNames[denseMode], predict(denseMode, wd));
+        // frontier size + out-degrees above which dense pull wins
+        if (denseMode == em_dense)
+          printf(" crossover %.0f", predict(em_dense, wd) /
+                 (cost[em_sparse] / work[em_sparse]));
+      } else printf(" fixed threshold");
+      printf(" -> %s\n", dense ? edgeMapModeNames[denseMode] : "sparse");
+    }
+    return dense;
+  }
+
+  void record(edgeMapMode mode, double w, double seconds, double joules) {
+    cost[mode] += energy ? joules : seconds;
+    work[mode] += w;
+    choices[mode]++;
+  }
+
+  void report() {
+    if (!adaptive) return;
+    for (int i=0; i<em_modes; i++) {
+      if (!choices[i]) continue;
+      printf("adapt: %s %ld calls, %.4g %s per unit of work\n",
+             edgeMapModeNames[i], choices[i], cost[i] / work[i],
+             energy ? "J" : "s");
+    }
+  }
+};
+densityPolicy edgeMapPolicy;
+
+//*****EDGEMAP TRACE*****
+
+// With -trace <file>, every edgeMapData call that does work appends one
+// record (round, frontier size, sum of its out-degrees or -1 if it was not
+// computed, mode, how the mode was chosen, output size, time and energy) to
+// a buffer of -tracesize records allocated up front. Calls past its end are
+// only counted. The buffer is written as CSV at the end of parallel_main.
+// Round -1 is the warmup.
+struct edgeMapRecord {
+  long round, frontier, outDegrees, output;
+  edgeMapMode mode;
+  bool adaptive;
+  double seconds, joules;
+};
+
+struct edgeMapTracer {
+  edgeMapRecord* records = NULL;
+  long capacity = 0, size = 0, dropped = 0, round = -1;
+  char* file = NULL;
+
+  bool on() { return records != NULL; }
+  void init(char* _file, long _capacity) {
+    file = _file;
+    capacity = _capacity;
+    records = newA(edgeMapRecord, capacity);
+  }
+  void record(const edgeMapRecord& r) {
+    if (size < capacity) records[size++] = r;
+    else dropped++;
+  }
+  void dump() {
+    if (!on()) return;
+    ofstream out(file);
+    if (!out.is_open()) {
+      cout << "Unable to open trace file " << file << endl;
+      return;
+    }
+    out << "round,frontier,out_degrees,mode,policy,output,seconds,joules\n";
+    for (long i=0; i<size; i++) {
+      edgeMapRecord& r = records[i];
+      out << r.round << "," << r.frontier << "," << r.outDegrees << ","
+          << edgeMapModeNames[r.mode] << ","
+          << (r.adaptive ? "adaptive" : "fixed") << "," << r.output << ","
+          << r.seconds << "," << r.joules << "\n";
+    }
+    cout << "edgeMap trace : " << size << " calls written to " << file;
+    if (dropped) cout << ", " << dropped << " dropped";
+    cout << endl;
+    free(records);
+    records = NULL;
+  }
+};
+edgeMapTracer edgeMapTrace;
+
 // Decides on sparse or dense base on number of nonzeros in the active vertices.
 template <class data, class vertex, class VS, class F>
 vertexSubsetData<data> edgeMapData(graph<vertex>& GA, VS &vs, F f,
     intT threshold = -1, const flags& fl=0) {
   long numVertices = GA.n, numEdges = GA.m, m = vs.numNonzeros();
+  // only the default threshold is replaced by the adaptive policy
+  bool adapt = edgeMapPolicy.adaptive && threshold == -1;
   if(threshold == -1) threshold = numEdges/20; //default threshold
   vertex *G = GA.V;
   if (numVertices != vs.numRows()) {
@@ -255,28 +652,60 @@ vertexSubsetData<data> edgeMapData(graph<vertex>& GA, VS &vs, F f,
     frontierVertices = newA(vertex,m);
     {parallel_for (size_t i=0; i < m; i++) {
 	uintE v_id = vs.vtx(i);
-	vertex v = G[v_id];
+	vertex v = localVertices(G)[v_id];
 	degrees[i] = v.getOutDegree();
 	frontierVertices[i] = v;
       }}
     outDegrees = sequence::plusReduce(degrees, m);
     if (outDegrees == 0) return vertexSubsetData<data>(numVertices);
+  } else adapt = false;
+  edgeMapMode denseMode = (fl & dense_forward) ? em_dense_forward : em_dense;
+  bool dense = !(fl & no_dense) && m + outDegrees > threshold;
+  if (adapt && !(fl & no_dense))
+    dense = edgeMapPolicy.chooseDense(denseMode, dense, numVertices, numEdges,
+                                      m, outDegrees);
+  edgeMapMode mode = dense ? denseMode : em_sparse;
+  double work = densityPolicy::modeWork(mode, numVertices, numEdges, m,
+                                        outDegrees);
+  bool trace = edgeMapTrace.on();
+  bool meterEnergy = trace || (adapt && edgeMapPolicy.energy);
+  rapl_snapshot before, after;
+  timer t;
+  if (meterEnergy) read_rapl_snapshot(&before);
+  if (trace || adapt) t.start();
+  auto run = [&] () -> vertexSubsetData<data> {
+    if (dense) {
+      if(degrees) free(degrees);
+      if(frontierVertices) free(frontierVertices);
+      vs.toDense();
+      edgesTraversed += ((fl & dense_forward) && threshold > 0) ? outDegrees : numEdges;
+      return (fl & dense_forward) ?
+        edgeMapDenseForward<data, vertex, VS, F>(GA, vs, f, fl) :
+        edgeMapDense<data, vertex, VS, F>(GA, vs, f, fl);
+    } else {
+      edgesTraversed += outDegrees;
+      auto vs_out =
+        (should_output(fl) && fl & sparse_no_filter) ? // only call snof when we output
+        edgeMapSparse_no_filter<data, vertex, VS, F>(GA, frontierVertices, vs, degrees, vs.numNonzeros(), f, fl) :
+        edgeMapSparse<data, vertex, VS, F>(GA, frontierVertices, vs, degrees, vs.numNonzeros(), f, fl);
+      free(degrees); free(frontierVertices);
+      return vs_out;
+    }
+  };
+  vertexSubsetData<data> vs_out = run();
+  if (trace || adapt) {
+    double seconds = t.stop(), joules = 0.0;
+    if (meterEnergy) {
+      read_rapl_snapshot(&after);
+      joules = rapl_snapshot_energy(&before, &after);
+    }
+    if (adapt) edgeMapPolicy.record(mode, work, seconds, joules);
+    if (trace)
+      edgeMapTrace.record({edgeMapTrace.round, m,
+          threshold > 0 ? (long)outDegrees : -1, (long)vs_out.numNonzeros(),
+          mode, adapt, seconds, joules});
   }
-  if (!(fl & no_dense) && m + outDegrees > threshold) {
-    if(degrees) free(degrees);
-    if(frontierVertices) free(frontierVertices);
-    vs.toDense();
-    return (fl & dense_forward) ?
-      edgeMapDenseForward<data, vertex, VS, F>(GA, vs, f, fl) :
-      edgeMapDense<data, vertex, VS, F>(GA, vs, f, fl);
-  } else {
-    auto vs_out =
-      (should_output(fl) && fl & sparse_no_filter) ? // only call snof when we output
-      edgeMapSparse_no_filter<data, vertex, VS, F>(GA, frontierVertices, vs, degrees, vs.numNonzeros(), f, fl) :
-      edgeMapSparse<data, vertex, VS, F>(GA, frontierVertices, vs, degrees, vs.numNonzeros(), f, fl);
-    free(degrees); free(frontierVertices);
-    return vs_out;
-  }
+  return vs_out;
 }
 
 // Regular edgeMap, where no extra data is stored per vertex.
@@ -292,6 +721,7 @@ vertexSubset edgeMap(graph<vertex>& GA, VS& vs, F f,
 template <class vertex, class P>
 vertexSubsetData<uintE> packEdges(graph<vertex>& GA, vertexSubset& vs, P& p, const flags& fl=0) {
   using S = tuple<uintE, uintE>;
+  dropVertexReplicas<vertex>();
   vs.toSparse();
   vertex* G = GA.V; long m = vs.numNonzeros(); long n = vs.numRows();
   if (vs.size() == 0) {
@@ -473,6 +903,76 @@ void Compute(graph<vertex>&, commandLine);
 template<class vertex>
 void Compute(hypergraph<vertex>&, commandLine);
 
+// Times and meters one phase of a run that is not part of a round
+struct phaseMeter {
+  timer t;
+  void start() { t.start(); start_rapl_sysfs(); }
+  void stop(const char* name) {
+    double energy = end_rapl_sysfs();
+    double seconds = t.stop();
+    printf("%s time : %.4f\n", name, seconds);
+    printf("%s energy : %.4f\n", name, energy);
+  }
+};
+
+// Restores the orientation the graph was loaded with, as its own phase, so
+// an application that transposes does not charge the restore to its rounds.
+template <class G>
+void restoreOrientation(G& GA) {
+  if(!GA.transposed) return;
+  phaseMeter phase;
+  phase.start();
+  GA.transpose();
+  phase.stop("Transpose");
+}
+
+// Runs Compute once as warmup and then rounds times, reporting the time,
+// energy, edges traversed and energy per edge of every round and their mean.
+template <class G>
+void runRounds(G& GA, commandLine P, long rounds) {
+  phaseMeter warmup;
+  warmup.start();
+  Compute(GA,P);
+  warmup.stop("Warmup");
+  restoreOrientation(GA);
+  timer t;
+  double totalTime = 0.0, totalEnergy = 0.0;
+  long totalEdges = 0;
+  rapl_snapshot before, after;
+  for(long r=0;r<rounds;r++) {
+    edgesTraversed = 0;
+    edgeMapTrace.round = r;
+    if(placement != place_default) read_rapl_snapshot(&before);
+    t.start();
+    start_rapl_sysfs();
+    Compute(GA,P);
+    double energy = end_rapl_sysfs();
+    double seconds = t.stop();
+    if(placement != place_default) {
+      read_rapl_snapshot(&after);
+      for(int k=0;k<rapl_packages();k++)
+        printf("Socket %d energy : %.4f DRAM %.4f\n", k,
+               rapl_snapshot_package_energy(&before, &after, k, 0),
+               rapl_snapshot_package_energy(&before, &after, k, 1));
+    }
+    long edges = edgesTraversed;
+    printf("Running time : %.4f\n", seconds);
+    printf("Energy : %.4f\n", energy);
+    printf("Edges traversed : %ld\n", edges);
+    if(edges > 0) printf("Energy per edge (nJ) : %.4f\n", 1e9 * energy / edges);
+    printf("\n");
+    totalTime += seconds; totalEnergy += energy; totalEdges += edges;
+    restoreOrientation(GA);
+  }
+  if(rounds > 0) {
+    printf("Average running time : %.4f\n", totalTime / rounds);
+    printf("Average energy : %.4f\n", totalEnergy / rounds);
+    if(totalEdges > 0)
+      printf("Average energy per edge (nJ) : %.4f\n", 1e9 * totalEnergy / totalEdges);
+  }
+  edgeMapPolicy.report();
+}
+
 int parallel_main(int argc, char* argv[]) {
   commandLine P(argc,argv," [-s] <inFile>");
   char* iFile = P.getArgument(0);
@@ -482,6 +982,19 @@ int parallel_main(int argc, char* argv[]) {
   bool mmap = P.getOptionValue("-m");
   //cout << "mmap = " << mmap << endl;
   long rounds = P.getOptionLongValue("-rounds",3);
+  rapl_init(); //Hiago MGA Rocha (14/12/2021)
+  char* adapt = P.getOptionValue("-adapt");
+  if (adapt) {
+    edgeMapPolicy.adaptive = true;
+    edgeMapPolicy.energy = !strcmp(adapt, "energy");
+    edgeMapPolicy.trace = P.getOption("-adapttrace");
+  }
+  char* traceFile = P.getOptionValue("-trace");
+  if (traceFile)
+    edgeMapTrace.init(traceFile, P.getOptionLongValue("-tracesize",1<<16));
+  setPlacement(P.getOptionValue("-numa"));
+  phaseMeter phase;
+  phase.start();
   if (compressed) {
     if (symmetric) {
 #ifndef HYPER
@@ -491,12 +1004,11 @@ int parallel_main(int argc, char* argv[]) {
       hypergraph<compressedSymmetricVertex> G =
         readCompressedHypergraph<compressedSymmetricVertex>(iFile,symmetric,mmap); //symmetric graph
 #endif
-      Compute(G,P);
-      for(int r=0;r<rounds;r++) {
-        startTime();
-        Compute(G,P);
-        nextTime("Running time");
-      }
+      phase.stop("Read graph");
+#ifndef HYPER
+      placeGraph(G,symmetric);
+#endif
+      runRounds(G,P,rounds);
       G.del();
     } else {
 #ifndef HYPER
@@ -506,14 +1018,17 @@ int parallel_main(int argc, char* argv[]) {
       hypergraph<compressedAsymmetricVertex> G =
         readCompressedHypergraph<compressedAsymmetricVertex>(iFile,symmetric,mmap); //asymmetric graph
 #endif
-      Compute(G,P);
-      if(G.transposed) G.transpose();
-      for(int r=0;r<rounds;r++) {
-        startTime();
-        Compute(G,P);
-        nextTime("Running time");
-        if(G.transposed) G.transpose();
-      }
+      phase.stop("Read graph");
+#ifndef HYPER
+      phase.start();
+      buildTransposeView(G);
+      phase.stop("Transpose view");
+      placeGraph(G,symmetric);
+#endif
+      runRounds(G,P,rounds);
+#ifndef HYPER
+      delTransposeView(G);
+#endif
       G.del();
     }
   } else {
@@ -525,12 +1040,11 @@ int parallel_main(int argc, char* argv[]) {
       hypergraph<symmetricVertex> G =
         readHypergraph<symmetricVertex>(iFile,compressed,symmetric,binary,mmap); //symmetric graph
 #endif
-      Compute(G,P);
-      for(int r=0;r<rounds;r++) {
-        startTime();
-        Compute(G,P);
-        nextTime("Running time");
-      }
+      phase.stop("Read graph");
+#ifndef HYPER
+      placeGraph(G,symmetric);
+#endif
+      runRounds(G,P,rounds);
       G.del();
     } else {
 #ifndef HYPER
@@ -540,28 +1054,20 @@ int parallel_main(int argc, char* argv[]) {
       hypergraph<asymmetricVertex> G =
         readHypergraph<asymmetricVertex>(iFile,compressed,symmetric,binary,mmap); //asymmetric graph
 #endif
-
-      rapl_init(); //Hiago MGA Rocha (14/12/2021)
-
-      double energy_curr = 0.0;
-
-      Compute(G,P);
-
-      if(G.transposed) G.transpose();
-      for(int r=0;r<rounds;r++)
-      {
-        startTime();
-        start_rapl_sysfs();
-        Compute(G,P);
-        energy_curr = end_rapl_sysfs();
-        nextTime("Running time");
-        
-        printf("Energy : %.4f\n\n", energy_curr);
-
-        if(G.transposed) G.transpose();
-      }
+      phase.stop("Read graph");
+#ifndef HYPER
+      phase.start();
+      buildTransposeView(G);
+      phase.stop("Transpose view");
+      placeGraph(G,symmetric);
+#endif
+      runRounds(G,P,rounds);
+#ifndef HYPER
+      delTransposeView(G);
+#endif
       G.del();
     }
   }
+  edgeMapTrace.dump();
 }
 #endif
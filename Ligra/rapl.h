@@ -1,3 +1,5 @@
+#ifndef RAPL_H
+#define RAPL_H
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -57,6 +59,20 @@ void ALARMhandler(int);
 double end_rapl_parcial_reading();
 /*---------------------------*/
 
+/* Counter snapshots that do not disturb an ongoing start/end measurement */
+struct rapl_snapshot {
+        long long uj[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+};
+void open_rapl_snapshot(void);
+void read_rapl_snapshot(struct rapl_snapshot *snap);
+void read_rapl_package_snapshot(struct rapl_snapshot *snap, int package);
+double rapl_snapshot_energy(const struct rapl_snapshot *before,
+                            const struct rapl_snapshot *after);
+int rapl_packages(void);
+double rapl_snapshot_package_energy(const struct rapl_snapshot *before,
+                                    const struct rapl_snapshot *after,
+                                    int package, int dram);
+
 /* Implementation */
 // Hiago MGA Rocha (14/12/2021)
 static int package_map[MAX_PACKAGES];
@@ -89,6 +105,7 @@ void rapl_init()
   detect_max_energy_range_uj();
   /*End initialization of RAPL */
   start_rapl_sysfs_global(); /* chamar so 1 vez*/
+  open_rapl_snapshot();
 }
 
 
@@ -260,7 +277,7 @@ double end_rapl_sysfs(){
                                 if(strcmp(event_names[j][i],"core")!=0 && strcmp(event_names[j][i],"uncore")!=0){
                                         double after  = (double)kernelAfter[j][i];
                                         double before = (double)kernelBefore[j][i];
-                                        if(before < after){
+                                        if(before <= after){
                                                 total += ((after-before)/1000000.0);
                                         }else{
                                                 total += (((max_energy_range_uj-before)+ after)/1000000.0);
@@ -287,7 +304,7 @@ double end_rapl_parcial_reading(){
                         for(k=0;k<leituras;k++) {
                                                 double current = (double) parcial[k][j][i];
 
-                                                if(before < current)
+                                                if(before <= current)
                         {
                                                         total += ((current-before)/1000000.0);
                                                 }else{
@@ -298,7 +315,7 @@ double end_rapl_parcial_reading(){
                                         }
 
                                         double after  = (double)kernelAfter[j][i];
-                                        if(before < after){
+                                        if(before <= after){
                                                 total += ((after-before)/1000000.0);
                                         }else{
                                                 total += (((max_energy_range_uj-before)+ after)/1000000.0);
@@ -314,6 +331,100 @@ double end_rapl_parcial_reading(){
 }
 
 
+/* The energy_uj file of every valid domain, opened once by rapl_init and
+   re-read with pread, so that snapshots are cheap enough to take per phase
+   or per round. Snapshots read zeros before rapl_init */
+static int snapshot_fd[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+static int snapshot_open = 0;
+
+void open_rapl_snapshot(void){
+        int i, j;
+        for(j=0;j<MAX_PACKAGES;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        if(snapshot_open && snapshot_fd[j][i]>=0) close(snapshot_fd[j][i]);
+                        snapshot_fd[j][i] = -1;
+                        if(j<total_packages && valid[j][i]) {
+                                snapshot_fd[j][i] = open(filenames[j][i], O_RDONLY);
+                                if(snapshot_fd[j][i]<0)
+                                        fprintf(stderr,"\tError opening %s!\n",filenames[j][i]);
+                        }
+                }
+        }
+        snapshot_open = 1;
+}
+
+/* Function used to read every counter without touching kernelBefore/After */
+void read_rapl_snapshot(struct rapl_snapshot *snap){
+        int j;
+        for(j=0;j<total_packages;j++)
+                read_rapl_package_snapshot(snap, j);
+}
+
+/* Same as read_rapl_snapshot() for the counters of one package only */
+void read_rapl_package_snapshot(struct rapl_snapshot *snap, int package){
+        int i;
+        char buffer[32];
+        for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                snap->uj[package][i] = 0;
+                if(!snapshot_open || snapshot_fd[package][i]<0) continue;
+                ssize_t n = pread(snapshot_fd[package][i], buffer, sizeof(buffer)-1, 0);
+                if(n>0) {
+                        buffer[n] = '\0';
+                        snap->uj[package][i] = atoll(buffer);
+                }
+        }
+}
+
+/* Energy (J) between two snapshots, summing the same domains as
+   end_rapl_sysfs(). Only one wrap-around per domain can be detected, so
+   snapshots should be taken less than PERIODO seconds apart */
+double rapl_snapshot_energy(const struct rapl_snapshot *before,
+                            const struct rapl_snapshot *after){
+        int i, j;
+        double total=0;
+        for(j=0;j<total_packages;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        if(valid[j][i]){
+                                if(strcmp(event_names[j][i],"core")!=0 && strcmp(event_names[j][i],"uncore")!=0){
+                                        double b = (double)before->uj[j][i];
+                                        double a = (double)after->uj[j][i];
+                                        if(b <= a){
+                                                total += ((a-b)/1000000.0);
+                                        }else{
+                                                total += (((max_energy_range_uj-b)+ a)/1000000.0);
+                                        }
+                                }
+                        }
+                }
+        }
+        return total;
+}
+
+int rapl_packages(void){
+        return total_packages;
+}
+
+/* Energy (J) of one package between two snapshots: its DRAM domain if dram
+   is set, otherwise the domains end_rapl_sysfs() sums except DRAM */
+double rapl_snapshot_package_energy(const struct rapl_snapshot *before,
+                                    const struct rapl_snapshot *after,
+                                    int package, int dram){
+        int i;
+        double total=0;
+        for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                if(!valid[package][i]) continue;
+                if(strcmp(event_names[package][i],"core")==0 || strcmp(event_names[package][i],"uncore")==0) continue;
+                if((strcmp(event_names[package][i],"dram")==0) != (dram!=0)) continue;
+                double b = (double)before->uj[package][i];
+                double a = (double)after->uj[package][i];
+                if(b <= a){
+                        total += ((a-b)/1000000.0);
+                }else{
+                        total += (((max_energy_range_uj-b)+ a)/1000000.0);
+                }
+        }
+        return total;
+}
 
 void ALARMhandler(int sig) {
     if(read_count_energy){
@@ -345,4 +456,6 @@ void detect_max_energy_range_uj(){
         max_energy_range_uj = (double) max;
         //printf("%.2f\n", max_energy_range_uj);
         fclose(file);
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,394 @@
+// Stream-VByte coding of adjacency lists for Ligra's compressed graphs.
+//
+// Each list is stored as its first edge, a zigzag varint of (edge - source)
+// as in byte.h, followed by the differences between consecutive edges in
+// Stream-VByte layout: one control byte per group of four differences,
+// holding their byte lengths (1-4, two bits each), then the data bytes of
+// all groups. Because the lengths of a whole group are known from a single
+// byte, a group is decoded with one 16-byte load, one byte shuffle and a
+// prefix sum instead of testing a continuation bit per byte. The SIMD path
+// needs SSSE3 (-march=native, as in the OPENMP build); otherwise the same
+// layout is decoded by a scalar loop. A weighted list is followed by its
+// weights, in order, as zigzag varints.
+//
+// decode() and decodeWgh() have the same contract as those of byte.h and
+// byteRLE.h: t.srcTarg(source, edge, [weight,] edgeNumber) is called for
+// each edge in order until it returns false. Edges must be 32 bits (no
+// EDGELONG) and sorted, as they are in every Ligra graph.
+//
+// The code lives in namespace svb so that CompressionBench can use it next
+// to the code the binary was built with. Building with STREAMVBYTE (make
+// STREAMVBYTE=1) also defines the global functions of byte.h at the end of
+// this file, which encoder.C and streamVByteVertex.h call.
+#ifndef STREAM_VBYTE_H
+#define STREAM_VBYTE_H
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include "parallel.h"
+#include "utils.h"
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+namespace svb {
+
+typedef unsigned char uchar;
+typedef std::pair<uintE,intE> intEPair;
+
+// Decoding a group may read up to this many bytes past its data, so every
+// buffer produced by compressEdges is padded by it
+const long kPadding = 16;
+
+struct tables {
+  uchar length[256];
+  uchar shuffle[256][16];
+  tables() {
+    for (int c=0; c<256; c++) {
+      int pos = 0;
+      for (int k=0; k<4; k++) {
+        int len = ((c >> (2*k)) & 3) + 1;
+        for (int b=0; b<4; b++)
+          shuffle[c][4*k+b] = (b < len) ? pos + b : 0x80;
+        pos += len;
+      }
+      length[c] = pos;
+    }
+  }
+};
+static const tables codes;
+
+inline int valueLength(uint32_t v) {
+  return (v < (1u << 8)) ? 1 : (v < (1u << 16)) ? 2 : (v < (1u << 24)) ? 3 : 4;
+}
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (v >> 1) ^ -(int32_t)(v & 1); }
+
+inline int32_t eatVarint(uchar* &start) {
+  uint32_t v = 0;
+  int shift = 0;
+  uchar b;
+  do {
+    b = *start++;
+    v |= (uint32_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return unzigzag(v);
+}
+
+inline long compressVarint(uchar* start, long offset, int32_t value) {
+  uint32_t v = zigzag(value);
+  while (v >= 0x80) {
+    start[offset++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  start[offset++] = v;
+  return offset;
+}
+
+inline long varintLength(int32_t value) {
+  uint32_t v = zigzag(value);
+  long len = 1;
+  while (v >= 0x80) { v >>= 7; len++; }
+  return len;
+}
+
+inline uintE eatFirstEdge(uchar* &start, uintE source) {
+  return source + eatVarint(start);
+}
+
+inline long compressFirstEdge(uchar* start, long offset, uintE source,
+                              uintE target) {
+  return compressVarint(start, offset, (int32_t)(target - source));
+}
+
+inline long controlBytes(uintT degree) { return (degree - 1 + 3) / 4; }
+
+// Data bytes of count differences, read from their control bytes
+inline long dataBytes(const uchar* control, uintT count) {
+  long bytes = 0;
+  uintT i = 0;
+  for (; i + 4 <= count; i += 4) bytes += codes.length[control[i / 4]];
+  for (; i < count; i++) bytes += ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+  return bytes;
+}
+
+// Bytes of the list of source, whose i-th edge is edge(i) and, if
+// weighted, whose i-th weight is weight(i)
+template <class E, class W>
+inline long listBytes(uintT degree, uintE source, E edge, W weight,
+                      bool weighted) {
+  if (degree == 0) return 0;
+  long bytes = varintLength((int32_t)(edge(0) - source)) + controlBytes(degree);
+  for (uintT i=1; i<degree; i++) bytes += valueLength(edge(i) - edge(i-1));
+  if (weighted)
+    for (uintT i=0; i<degree; i++) bytes += varintLength(weight(i));
+  return bytes;
+}
+
+// Encodes that list at edgeArray + offset, returning the offset just past it
+template <class E, class W>
+inline long encodeList(uchar* edgeArray, long offset, uintT degree,
+                       uintE source, E edge, W weight, bool weighted) {
+  if (degree == 0) return offset;
+  offset = compressFirstEdge(edgeArray, offset, source, edge(0));
+  uchar* control = edgeArray + offset;
+  uchar* data = control + controlBytes(degree);
+  memset(control, 0, controlBytes(degree));
+  for (uintT i=1; i<degree; i++) {
+    uint32_t d = edge(i) - edge(i-1);
+    int len = valueLength(d);
+    control[(i-1) / 4] |= (len - 1) << (2 * ((i-1) % 4));
+    for (int b=0; b<len; b++) *data++ = d >> (8*b);
+  }
+  offset = data - edgeArray;
+  if (weighted)
+    for (uintT i=0; i<degree; i++)
+      offset = compressVarint(edgeArray, offset, weight(i));
+  return offset;
+}
+
+inline long edgeSetBytes(uintT degree, uintE source, const uintE* edges) {
+  return listBytes(degree, source, [&] (uintT i) { return edges[i]; },
+                   [] (uintT) { return 0; }, false);
+}
+
+inline long edgeSetBytes(uintT degree, uintE source, const intEPair* edges) {
+  return listBytes(degree, source, [&] (uintT i) { return edges[i].first; },
+                   [&] (uintT i) { return edges[i].second; }, true);
+}
+
+// Encodes the edges of source at edgeArray + offset, returning the offset
+// just past them (the analogue of sequentialCompressEdgeSet in byte.h)
+inline long compressEdgeSet(uchar* edgeArray, long offset, uintT degree,
+                            uintE source, const uintE* edges) {
+  return encodeList(edgeArray, offset, degree, source,
+                    [&] (uintT i) { return edges[i]; },
+                    [] (uintT) { return 0; }, false);
+}
+
+inline long compressEdgeSet(uchar* edgeArray, long offset, uintT degree,
+                            uintE source, const intEPair* edges) {
+  return encodeList(edgeArray, offset, degree, source,
+                    [&] (uintT i) { return edges[i].first; },
+                    [&] (uintT i) { return edges[i].second; }, true);
+}
+
+// Decodes count differences into absolute edges, continuing from prev, and
+// returns the position of the next group's data
+inline uchar* decodeDeltas(const uchar* control, uchar* data, uintT count,
+                           uintE prev, uintE* out) {
+  uintT i = 0;
+#ifdef __SSSE3__
+  __m128i carry = _mm_set1_epi32(prev);
+  for (; i + 4 <= count; i += 4) {
+    uchar c = control[i / 4];
+    __m128i v = _mm_loadu_si128((const __m128i*) data);
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*) codes.shuffle[c]));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi32(v, carry);
+    _mm_storeu_si128((__m128i*) (out + i), v);
+    carry = _mm_shuffle_epi32(v, 0xff);
+    data += codes.length[c];
+  }
+  if (i) prev = out[i-1];
+#endif
+  for (; i < count; i++) {
+    int len = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+    uint32_t d = 0;
+    for (int b=0; b<len; b++) d |= (uint32_t)data[b] << (8*b);
+    data += len;
+    prev += d;
+    out[i] = prev;
+  }
+  return data;
+}
+
+// Decodes the whole list into out[0..degree) and returns where its weights,
+// if it has any, start
+inline uchar* decodeAll(uchar* edgeStart, uintE source, uintT degree,
+                        uintE* out) {
+  if (degree == 0) return edgeStart;
+  out[0] = eatFirstEdge(edgeStart, source);
+  return decodeDeltas(edgeStart, edgeStart + controlBytes(degree), degree - 1,
+                      out[0], out + 1);
+}
+
+// Calls t.srcTarg on each edge until it returns false. Edges are decoded in
+// blocks so that breaking early does not decode the whole list.
+template <class T>
+inline void decode(T t, uchar* edgeStart, const uintE &source,
+                   const uintT &degree, const bool par=true) {
+  if (degree == 0) return;
+  const uintT kBlock = 64;
+  uintE block[kBlock];
+  uintE prev = eatFirstEdge(edgeStart, source);
+  if (!t.srcTarg(source, prev, 0)) return;
+  const uchar* control = edgeStart;
+  uchar* data = edgeStart + controlBytes(degree);
+  for (uintT done=1; done < degree; done += kBlock) {
+    uintT count = std::min(kBlock, degree - done);
+    data = decodeDeltas(control, data, count, prev, block);
+    control += kBlock / 4;
+    for (uintT j=0; j<count; j++) {
+      if (!t.srcTarg(source, block[j], done + j)) return;
+    }
+    prev = block[count-1];
+  }
+}
+
+// The same for a weighted list; the weights are found by summing the
+// lengths in the control bytes
+template <class T>
+inline void decodeWgh(T t, uchar* edgeStart, const uintE &source,
+                      const uintT &degree, const bool par=true) {
+  if (degree == 0) return;
+  const uintT kBlock = 64;
+  uintE block[kBlock];
+  uintE prev = eatFirstEdge(edgeStart, source);
+  const uchar* control = edgeStart;
+  uchar* data = edgeStart + controlBytes(degree);
+  uchar* weights = data + dataBytes(control, degree - 1);
+  if (!t.srcTarg(source, prev, eatVarint(weights), 0)) return;
+  for (uintT done=1; done < degree; done += kBlock) {
+    uintT count = std::min(kBlock, degree - done);
+    data = decodeDeltas(control, data, count, prev, block);
+    control += kBlock / 4;
+    for (uintT j=0; j<count; j++) {
+      if (!t.srcTarg(source, block[j], eatVarint(weights), done + j)) return;
+    }
+    prev = block[count-1];
+  }
+}
+
+// Keeps the edges of a list for which pred(source, edge) holds and
+// re-encodes them in place, returning the new degree. tmp holds degree
+// edges. A kept subset never takes more bytes than the list it came from:
+// merging two differences takes at most the bytes of both, and so does
+// moving the first edge past a removed one.
+template <class P>
+inline size_t pack(P &pred, uchar* edgeStart, const uintE &source,
+                   const uintE &degree, uintE* tmp) {
+  decodeAll(edgeStart, source, degree, tmp);
+  size_t k = 0;
+  for (uintE i=0; i<degree; i++) {
+    if (pred(source, tmp[i])) tmp[k++] = tmp[i];
+  }
+  compressEdgeSet(edgeStart, 0, k, source, tmp);
+  return k;
+}
+
+// The same for a weighted list, with pred(source, edge, weight); tmpWgh
+// holds degree weights
+template <class P>
+inline size_t packWgh(P &pred, uchar* edgeStart, const uintE &source,
+                      const uintE &degree, uintE* tmp, intE* tmpWgh) {
+  uchar* weights = decodeAll(edgeStart, source, degree, tmp);
+  size_t k = 0;
+  for (uintE i=0; i<degree; i++) {
+    intE w = eatVarint(weights);
+    if (pred(source, tmp[i], w)) { tmp[k] = tmp[i]; tmpWgh[k] = w; k++; }
+  }
+  encodeList(edgeStart, 0, k, source, [&] (uintT i) { return tmp[i]; },
+             [&] (uintT i) { return tmpWgh[i]; }, true);
+  return k;
+}
+
+// Encodes the out-edges of every vertex in parallel. getEdges(i) returns
+// the sorted neighbors (uintE*) or neighbor-weight pairs (intEPair*) of
+// vertex i and degree(i) their number. Returns the padded byte array;
+// byteOffsets[i] is where vertex i starts and byteOffsets[n] the encoded
+// size, not counting the padding.
+template <class E, class D>
+uchar* compressEdges(long n, E getEdges, D degree, uintT* byteOffsets) {
+  {parallel_for (long i=0; i<n; i++) {
+    byteOffsets[i] = edgeSetBytes(degree(i), i, getEdges(i));
+  }}
+  byteOffsets[n] = sequence::plusScan(byteOffsets, byteOffsets, n);
+  uchar* edgeArray = newA(uchar, byteOffsets[n] + kPadding);
+  {parallel_for (long i=0; i<n; i++) {
+    compressEdgeSet(edgeArray, byteOffsets[i], degree(i), i, getEdges(i));
+  }}
+  memset(edgeArray + byteOffsets[n], 0, kPadding);
+  return edgeArray;
+}
+
+// parallelCompressEdges of byte.h: edges + offsets[i] holds the Degrees[i]
+// sorted edges of vertex i. offsets is overwritten with the byte offsets,
+// and offsets[n] is the size to store, which includes the padding so that
+// the padding is also in the file the encoder writes.
+template <class E>
+uchar* compressEdgeArray(E* edges, uintT* offsets, long n, long m,
+                         uintE* Degrees) {
+  std::cout << "parallel compressing, (n,m) = (" << n << "," << m << ")"
+            << std::endl;
+  uintT* edgeOffsets = newA(uintT, n);
+  {parallel_for (long i=0; i<n; i++) edgeOffsets[i] = offsets[i];}
+  uchar* edgeArray = compressEdges(n, [&] (long i) { return edges + edgeOffsets[i]; },
+                                   [&] (long i) { return Degrees[i]; }, offsets);
+  free(edgeOffsets);
+  offsets[n] += kPadding;
+  std::cout << "total space requested is : " << offsets[n] << std::endl;
+  std::cout << "Average bits per edge: " << (m ? 8.0 * offsets[n] / m : 0.0)
+            << std::endl;
+  return edgeArray;
+}
+
+}  // namespace svb
+
+#ifdef STREAMVBYTE
+typedef unsigned char uchar;
+typedef svb::intEPair intEPair;
+
+template <class T>
+inline void decode(T t, uchar* edgeStart, const uintE &source,
+                   const uintT &degree, const bool par=true) {
+  svb::decode(t, edgeStart, source, degree, par);
+}
+
+template <class T>
+inline void decodeWgh(T t, uchar* edgeStart, const uintE &source,
+                      const uintT &degree, const bool par=true) {
+  svb::decodeWgh(t, edgeStart, source, degree, par);
+}
+
+template <class P>
+inline size_t pack(P &pred, uchar* edgeStart, const uintE &source,
+                   const uintE &degree, uintE* tmp) {
+  return svb::pack(pred, edgeStart, source, degree, tmp);
+}
+
+template <class P>
+inline size_t packWgh(P &pred, uchar* edgeStart, const uintE &source,
+                      const uintE &degree, uintE* tmp, intE* tmpWgh) {
+  return svb::packWgh(pred, edgeStart, source, degree, tmp, tmpWgh);
+}
+
+inline long sequentialCompressEdgeSet(uchar *edgeArray, long currentOffset,
+    uintT degree, uintE vertexNum, uintE *savedEdges) {
+  return svb::compressEdgeSet(edgeArray, currentOffset, degree, vertexNum,
+                              savedEdges);
+}
+
+inline long sequentialCompressWeightedEdgeSet(uchar *edgeArray,
+    long currentOffset, uintT degree, uintE vertexNum, intEPair *savedEdges) {
+  return svb::compressEdgeSet(edgeArray, currentOffset, degree, vertexNum,
+                              savedEdges);
+}
+
+inline uchar* parallelCompressEdges(uintE* edges, uintT* offsets, long n,
+                                    long m, uintE* Degrees) {
+  return svb::compressEdgeArray(edges, offsets, n, m, Degrees);
+}
+
+inline uchar* parallelCompressWeightedEdges(intEPair* edges, uintT* offsets,
+                                            long n, long m, uintE* Degrees) {
+  return svb::compressEdgeArray(edges, offsets, n, m, Degrees);
+}
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+// Compressed vertices whose edge lists are in the Stream-VByte code of
+// streamVByte.h. compressedVertex.h here selects this header over
+// upstream's when built with STREAMVBYTE. The vertices have the same
+// members, and the decode loops call srcTarg the same way as that header.
+// Its lists come from encoder.C built with STREAMVBYTE. Graphs written by
+// the byte codes cannot be read by a STREAMVBYTE build, or the other way
+// round.
+#ifndef STREAM_VBYTE_VERTEX_H
+#define STREAM_VBYTE_VERTEX_H
+#include "streamVByte.h"
+
+namespace decode_svb {
+
+#ifndef WEIGHTED
+#define SVB_DECODE decode
+#define SVB_TARGET const uintE& src, const uintE& target, const uintT& edgeNumber
+#define SVB_WGH
+#else
+#define SVB_DECODE decodeWgh
+#define SVB_TARGET const uintE& src, const uintE& target, const intE& weight, const uintT& edgeNumber
+#define SVB_WGH , weight
+#endif
+
+  // edgeMapDense: decodes the in-edges of src, calling update for each
+  // in-neighbor in the frontier until cond(src) turns false
+  template <class F, class G, class VS>
+  struct denseT {
+    F &f; G &g; VS &vertexSubset;
+    denseT(F &_f, G &_g, VS &_vs) : f(_f), g(_g), vertexSubset(_vs) {}
+    inline bool srcTarg(SVB_TARGET) {
+      if (vertexSubset.isIn(target)) {
+        auto m = f.update(target, src SVB_WGH);
+        g(src, m);
+      }
+      return f.cond(src);
+    }
+  };
+
+  // edgeMapDenseForward
+  template <class F, class G>
+  struct denseForwardT {
+    F &f; G &g;
+    denseForwardT(F &_f, G &_g) : f(_f), g(_g) {}
+    inline bool srcTarg(SVB_TARGET) {
+      if (f.cond(target)) {
+        auto m = f.updateAtomic(src, target SVB_WGH);
+        g(target, m);
+      }
+      return true;
+    }
+  };
+
+  // edgeMapSparse: one output slot per edge, starting at offset
+  template <class F, class G>
+  struct sparseT {
+    F &f; G &g; uintT offset;
+    sparseT(F &_f, G &_g, uintT _o) : f(_f), g(_g), offset(_o) {}
+    inline bool srcTarg(SVB_TARGET) {
+      if (f.cond(target)) {
+        auto m = f.updateAtomic(src, target SVB_WGH);
+        g(target, offset + edgeNumber, m);
+      } else {
+        g(target, offset + edgeNumber);
+      }
+      return true;
+    }
+  };
+
+  // edgeMapSparse_no_filter: output slots only for the edges g writes
+  template <class F, class G>
+  struct sparseSeqT {
+    F &f; G &g; uintT offset; size_t &k;
+    sparseSeqT(F &_f, G &_g, uintT _o, size_t &_k) : f(_f), g(_g), offset(_o), k(_k) {}
+    inline bool srcTarg(SVB_TARGET) {
+      if (f.cond(target)) {
+        auto m = f.updateAtomic(src, target SVB_WGH);
+        if (g(target, offset + k, m)) k++;
+      }
+      return true;
+    }
+  };
+
+  template <class P>
+  struct countT {
+    P &pred; size_t &count;
+    countT(P &_p, size_t &_c) : pred(_p), count(_c) {}
+    inline bool srcTarg(SVB_TARGET) {
+      count += pred(src, target SVB_WGH);
+      return true;
+    }
+  };
+
+  template <class V, class VS, class F, class G>
+  inline void decodeInNghBreakEarly(V* v, long i, VS& vertexSubset, F &f,
+                                    G &g, bool parallel = 0) {
+    SVB_DECODE(denseT<F,G,VS>(f, g, vertexSubset), v->getInNeighbors(), i,
+               v->getInDegree(), parallel);
+  }
+
+  template <class V, class F, class G>
+  inline void decodeOutNgh(V* v, long i, F &f, G &g) {
+    SVB_DECODE(denseForwardT<F,G>(f, g), v->getOutNeighbors(), i,
+               v->getOutDegree());
+  }
+
+  template <class V, class F, class G>
+  inline void decodeOutNghSparse(V* v, long i, uintT o, F &f, G &g) {
+    SVB_DECODE(sparseT<F,G>(f, g, o), v->getOutNeighbors(), i,
+               v->getOutDegree());
+  }
+
+  template <class V, class F, class G>
+  inline size_t decodeOutNghSparseSeq(V* v, long i, uintT o, F &f, G &g) {
+    size_t k = 0;
+    SVB_DECODE(sparseSeqT<F,G>(f, g, o, k), v->getOutNeighbors(), i,
+               v->getOutDegree());
+    return k;
+  }
+
+  template <class V, class P>
+  inline size_t countOutNgh(V* v, long i, P &pred) {
+    size_t count = 0;
+    SVB_DECODE(countT<P>(pred, count), v->getOutNeighbors(), i,
+               v->getOutDegree());
+    return count;
+  }
+
+  template <class V, class P>
+  inline size_t packOutNgh(V* v, long i, P &pred, bool* bits, uintE* tmp1,
+                           uintE* tmp2) {
+#ifndef WEIGHTED
+    size_t k = pack(pred, v->getOutNeighbors(), i, v->getOutDegree(), tmp1);
+#else
+    size_t k = packWgh(pred, v->getOutNeighbors(), i, v->getOutDegree(), tmp1,
+                       (intE*) tmp2);
+#endif
+    v->setOutDegree(k);
+    return k;
+  }
+
+#undef SVB_DECODE
+#undef SVB_TARGET
+#undef SVB_WGH
+
+}  // namespace decode_svb
+
+#define SVB_VERTEX_DECODERS                                                  \
+  template <class VS, class F, class G>                                      \
+  inline void decodeInNghBreakEarly(const uintE vtx_id, VS& vertexSubset,    \
+                                    F &f, G &g, bool parallel = 0) {         \
+    decode_svb::decodeInNghBreakEarly(this, vtx_id, vertexSubset, f, g,      \
+                                      parallel);                             \
+  }                                                                          \
+  template <class F, class G>                                                \
+  inline void decodeOutNgh(const uintE vtx_id, F &f, G &g) {                 \
+    decode_svb::decodeOutNgh(this, vtx_id, f, g);                            \
+  }                                                                          \
+  template <class F, class G>                                                \
+  inline void decodeOutNghSparse(const uintE vtx_id, uintT o, F &f, G &g) {  \
+    decode_svb::decodeOutNghSparse(this, vtx_id, o, f, g);                   \
+  }                                                                          \
+  template <class F, class G>                                                \
+  inline size_t decodeOutNghSparseSeq(const uintE vtx_id, uintT o, F &f,     \
+                                      G &g) {                                \
+    return decode_svb::decodeOutNghSparseSeq(this, vtx_id, o, f, g);         \
+  }                                                                          \
+  template <class P>                                                         \
+  inline size_t countOutNgh(const uintE vtx_id, P &pred) {                   \
+    return decode_svb::countOutNgh(this, vtx_id, pred);                      \
+  }                                                                          \
+  template <class P>                                                         \
+  inline size_t packOutNgh(const uintE vtx_id, P &pred, bool* bits,          \
+                           uintE* tmp1, uintE* tmp2) {                       \
+    return decode_svb::packOutNgh(this, vtx_id, pred, bits, tmp1, tmp2);     \
+  }
+
+struct compressedSymmetricVertex {
+  uchar* neighbors;
+  uintT degree;
+  uchar* getInNeighbors() { return neighbors; }
+  const uchar* getInNeighbors() const { return neighbors; }
+  uchar* getOutNeighbors() { return neighbors; }
+  const uchar* getOutNeighbors() const { return neighbors; }
+  uintT getInDegree() const { return degree; }
+  uintT getOutDegree() const { return degree; }
+  void setInNeighbors(uchar* _i) { neighbors = _i; }
+  void setOutNeighbors(uchar* _i) { neighbors = _i; }
+  void setInDegree(uintT _d) { degree = _d; }
+  void setOutDegree(uintT _d) { degree = _d; }
+  void flipEdges() {}
+  void del() {}
+  SVB_VERTEX_DECODERS
+};
+
+struct compressedAsymmetricVertex {
+  uchar* inNeighbors;
+  uchar* outNeighbors;
+  uintT outDegree;
+  uintT inDegree;
+  uchar* getInNeighbors() { return inNeighbors; }
+  const uchar* getInNeighbors() const { return inNeighbors; }
+  uchar* getOutNeighbors() { return outNeighbors; }
+  const uchar* getOutNeighbors() const { return outNeighbors; }
+  uintT getInDegree() const { return inDegree; }
+  uintT getOutDegree() const { return outDegree; }
+  void setInNeighbors(uchar* _i) { inNeighbors = _i; }
+  void setOutNeighbors(uchar* _i) { outNeighbors = _i; }
+  void setInDegree(uintT _d) { inDegree = _d; }
+  void setOutDegree(uintT _d) { outDegree = _d; }
+  void flipEdges() { std::swap(inNeighbors,outNeighbors); std::swap(inDegree,outDegree); }
+  void del() {}
+  SVB_VERTEX_DECODERS
+};
+
+#undef SVB_VERTEX_DECODERS
+
+#endif
@@ -56,8 +56,13 @@ Authors of the OpenMP code:
 */
 
 #include "omp.h"
+#include <algorithm>
+#include <cstring>
 #include "../common/npb-CPP.hpp"
 #include "npbparams.hpp"
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include "../common/rapl.h" //Hiago MGA Rocha (24/11/2021)
 
 /*
@@ -84,6 +89,19 @@ Authors of the OpenMP code:
 #define T_CONJ_GRAD 2
 #define T_LAST 3
 
+/*
+ * ---------------------------------------------------------------------
+ * SELL-C-sigma copy of the matrix, used instead of the CSR loops when
+ * CG_SPMV=sell. rows are sorted by length within windows of SELL_SIGMA
+ * rows and cut into slices of SELL_C rows; each slice is padded to its
+ * longest row and stored column-major, so one step of the multiply
+ * handles SELL_C rows with one gather of p. the elements of a row keep
+ * their CSR order, so every row sums in the same order as in CSR.
+ * ---------------------------------------------------------------------
+ */
+#define SELL_C 8
+#define SELL_SIGMA 512
+
 /* global variables */
 #if defined(DO_NOT_ALLOCATE_ARRAYS_WITH_DYNAMIC_MEMORY_AND_AS_SINGLE_DIMENSION)
 static int colidx[NZ];
@@ -98,6 +116,10 @@ static double z[NA+2];
 static double p[NA+2];
 static double q[NA+2];
 static double r[NA+2];
+static double pw0[NA+2];
+static double pw1[NA+2];
+static double ps[NA+2];
+static double pu[NA+2];
 #else
 static int (*colidx)=(int*)malloc(sizeof(int)*(NZ));
 static int (*rowstr)=(int*)malloc(sizeof(int)*(NA+1));
@@ -111,6 +133,10 @@ static double (*z)=(double*)malloc(sizeof(double)*(NA+2));
 static double (*p)=(double*)malloc(sizeof(double)*(NA+2));
 static double (*q)=(double*)malloc(sizeof(double)*(NA+2));
 static double (*r)=(double*)malloc(sizeof(double)*(NA+2));
+static double (*pw0)=(double*)malloc(sizeof(double)*(NA+2));
+static double (*pw1)=(double*)malloc(sizeof(double)*(NA+2));
+static double (*ps)=(double*)malloc(sizeof(double)*(NA+2));
+static double (*pu)=(double*)malloc(sizeof(double)*(NA+2));
 #endif
 static int naa;
 static int nzz;
@@ -121,6 +147,13 @@ static int lastcol;
 static double amult;
 static double tran;
 static boolean timeron;
+static boolean use_sell;
+static boolean use_pipelined;
+static int sell_nslices;
+static int* sell_sliceptr;
+static int* sell_perm;
+static int* sell_col;
+static double* sell_val;
 
 /* function prototypes */
 static void conj_grad(int colidx[],
@@ -132,6 +165,21 @@ static void conj_grad(int colidx[],
 		double q[],
 		double r[],
 		double* rnorm);
+static void conj_grad_pipelined(int colidx[],
+		int rowstr[],
+		double x[],
+		double z[],
+		double a[],
+		double p[],
+		double q[],
+		double r[],
+		double* rnorm);
+static void build_sell(int colidx[],
+		int rowstr[],
+		double a[],
+		int nrows);
+static void sell_spmv(const double v[],
+		double w[]);
 static int icnvrt(double x,
 		int ipwr2);
 static void makea(int n,
@@ -208,6 +256,11 @@ rapl_init(); //Hiago MGA Rocha (24/11/2021)
 		timeron = FALSE;
 	}
 
+	char* spmv_format = std::getenv("CG_SPMV");
+	use_sell = (spmv_format != NULL && strcmp(spmv_format, "sell") == 0);
+	char* solver = std::getenv("CG_SOLVER");
+	use_pipelined = (solver != NULL && strcmp(solver, "pipelined") == 0);
+
 	timer_start(T_INIT);
 
 	firstrow = 0;
@@ -268,6 +321,17 @@ rapl_init(); //Hiago MGA Rocha (24/11/2021)
 			(double(*)[NONZER+1])(void*)aelt,
 			iv);
 
+	if(use_sell){
+		build_sell(colidx, rowstr, a, lastrow - firstrow + 1);
+	}else{
+		printf(" SpMV format: CSR\n");
+	}
+	if(use_pipelined){
+		printf(" CG solver: pipelined, barriers per cg iteration: %d\n", use_sell ? 2 : 1);
+	}else{
+		printf(" CG solver: standard, barriers per cg iteration: %d\n", use_sell ? 4 : 3);
+	}
+
 	/*
 	 * ---------------------------------------------------------------------
 	 * note: as a result of the above call to makea:
@@ -312,7 +376,11 @@ rapl_init(); //Hiago MGA Rocha (24/11/2021)
 
 		for(it = 1; it <= 1; it++){
 			/* the call to the conjugate gradient routine */
-			conj_grad(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+			if(use_pipelined){
+				conj_grad_pipelined(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+			}else{
+				conj_grad(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+			}
 			#pragma omp single
 			{
 				norm_temp1 = 0.0;
@@ -374,7 +442,11 @@ rapl_init(); //Hiago MGA Rocha (24/11/2021)
 			/* the call to the conjugate gradient routine */
 			#pragma omp master
 			if(timeron){timer_start(T_CONJ_GRAD);}
-			conj_grad(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+			if(use_pipelined){
+				conj_grad_pipelined(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+			}else{
+				conj_grad(colidx, rowstr, x, z, a, p, q, r, &rnorm);
+			}
 			#pragma omp master
 			if(timeron){timer_stop(T_CONJ_GRAD);}
 
@@ -463,6 +535,7 @@ rapl_init(); //Hiago MGA Rocha (24/11/2021)
 			0,
 			NITER,
 			t,
+			T_BENCH,
 			mflops,
 			(char*)"          floating point",
 			verified,
@@ -491,9 +564,11 @@ rapl_init(); //Hiago MGA Rocha (24/11/2021)
 		for(i = 0; i < T_LAST; i++){
 			t = timer_read(i);
 			if(i == T_INIT){
-				printf("  %8s:%9.3f\n", t_names[i], t);
+				printf("  %8s:%9.3f            %10.3f J %8.2f W\n", t_names[i], t,
+						timer_read_energy(i), timer_read_power(i));
 			}else{
-				printf("  %8s:%9.3f  (%6.2f%%)\n", t_names[i], t, t*100.0/tmax);
+				printf("  %8s:%9.3f  (%6.2f%%) %10.3f J %8.2f W\n", t_names[i], t, t*100.0/tmax,
+						timer_read_energy(i), timer_read_power(i));
 				if(i == T_CONJ_GRAD){
 					t = tmax - t;
 					printf("    --> %8s:%9.3f  (%6.2f%%)\n", "rest", t, t*100.0/tmax);
@@ -588,13 +663,17 @@ static void conj_grad(int colidx[],
 			rho = 0.0;
 		}
 
-		#pragma omp for nowait
-		for(j = 0; j < lastrow - firstrow + 1; j++){
-			suml = 0.0;
-			for(k = rowstr[j]; k < rowstr[j+1]; k++){
-				suml += a[k]*p[colidx[k]];
+		if(use_sell){
+			sell_spmv(p, q);
+		}else{
+			#pragma omp for nowait
+			for(j = 0; j < lastrow - firstrow + 1; j++){
+				suml = 0.0;
+				for(k = rowstr[j]; k < rowstr[j+1]; k++){
+					suml += a[k]*p[colidx[k]];
+				}
+				q[j] = suml;
 			}
-			q[j] = suml;
 		}
 
 		/*
@@ -661,13 +740,17 @@ static void conj_grad(int colidx[],
 	 * the partition submatrix-vector multiply
 	 * ---------------------------------------------------------------------
 	 */
-	#pragma omp for nowait
-	for(j = 0; j < lastrow - firstrow + 1; j++){
-		suml = 0.0;
-		for(k = rowstr[j]; k < rowstr[j+1]; k++){
-			suml += a[k]*z[colidx[k]];
+	if(use_sell){
+		sell_spmv(z, r);
+	}else{
+		#pragma omp for nowait
+		for(j = 0; j < lastrow - firstrow + 1; j++){
+			suml = 0.0;
+			for(k = rowstr[j]; k < rowstr[j+1]; k++){
+				suml += a[k]*z[colidx[k]];
+			}
+			r[j] = suml;
 		}
-		r[j] = suml;
 	}
 
 	/*
@@ -684,6 +767,294 @@ static void conj_grad(int colidx[],
 		*rnorm = sqrt(sum);
 }
 
+/*
+ * ---------------------------------------------------------------------
+ * pipelined conjugate gradient (Ghysels and Vanroose), used when
+ * CG_SOLVER=pipelined. it runs the same cgitmax iterations from z = 0
+ * but carries w = A.r, s = A.p and u = A.s along, so that both dot
+ * products of an iteration, (r,r) and (w,r), are formed in the loop
+ * that updates the vectors and reduced once, and the only matrix
+ * product is q = A.w, which needs no dot product of its own. each
+ * thread keeps to its own static rows; w is double-buffered and the
+ * partial sums alternate between two slots, so with the CSR multiply
+ * the barrier of the update loop is the only one per iteration
+ * (SELL adds the barrier of its permuted multiply)
+ * ---------------------------------------------------------------------
+ */
+#define PIPE_PAD 8
+static double* pipe_partial;
+
+static void conj_grad_pipelined(int colidx[],
+		int rowstr[],
+		double x[],
+		double z[],
+		double a[],
+		double p[],
+		double q[],
+		double r[],
+		double* rnorm){
+	int j, k, t, slot;
+	int cgit, cgitmax;
+	int n = lastcol - firstcol + 1;
+	int tid = omp_get_thread_num();
+	int nthreads = omp_get_num_threads();
+	double alpha, alpha_old, beta, gamma, gamma_old, delta, suml;
+	double lgamma, ldelta;
+	double* w = pw0;
+	double* wnext = pw1;
+	double* tmp;
+	static double sum;
+
+	cgitmax = 25;
+	#pragma omp single
+	{
+		sum = 0.0;
+		if(pipe_partial == NULL){
+			pipe_partial = (double*)calloc(2*PIPE_PAD*omp_get_max_threads(), sizeof(double));
+		}
+	}
+	/* initialize the CG algorithm */
+	#pragma omp for
+	for(j = 0; j < naa+1; j++){
+		q[j] = 0.0;
+		z[j] = 0.0;
+		r[j] = x[j];
+		p[j] = 0.0;
+		ps[j] = 0.0;
+		pu[j] = 0.0;
+	}
+
+	/* w = A.r, with the first (r,r) and (w,r) */
+	if(use_sell){
+		sell_spmv(r, w);
+	}
+	lgamma = 0.0;
+	ldelta = 0.0;
+	#pragma omp for schedule(static) nowait
+	for(j = 0; j < n; j++){
+		if(!use_sell){
+			suml = 0.0;
+			for(k = rowstr[j]; k < rowstr[j+1]; k++){
+				suml += a[k]*r[colidx[k]];
+			}
+			w[j] = suml;
+		}
+		lgamma += r[j]*r[j];
+		ldelta += w[j]*r[j];
+	}
+	pipe_partial[tid*2*PIPE_PAD] = lgamma;
+	pipe_partial[tid*2*PIPE_PAD+1] = ldelta;
+	#pragma omp barrier
+
+	alpha_old = 1.0;
+	gamma_old = 1.0;
+	for(cgit = 1; cgit <= cgitmax; cgit++){
+		/* every thread sums the partials in the same order */
+		slot = ((cgit - 1) & 1) * PIPE_PAD;
+		gamma = 0.0;
+		delta = 0.0;
+		for(t = 0; t < nthreads; t++){
+			gamma += pipe_partial[t*2*PIPE_PAD+slot];
+			delta += pipe_partial[t*2*PIPE_PAD+slot+1];
+		}
+		if(cgit == 1){
+			beta = 0.0;
+			alpha = gamma / delta;
+		}else{
+			beta = gamma / gamma_old;
+			alpha = gamma / (delta - beta * gamma / alpha_old);
+		}
+
+		/* q = A.w */
+		if(use_sell){
+			sell_spmv(w, q);
+		}else{
+			#pragma omp for schedule(static) nowait
+			for(j = 0; j < n; j++){
+				suml = 0.0;
+				for(k = rowstr[j]; k < rowstr[j+1]; k++){
+					suml += a[k]*w[colidx[k]];
+				}
+				q[j] = suml;
+			}
+		}
+
+		/*
+		 * ---------------------------------------------------------------------
+		 * u = q + beta*u, s = w + beta*s, p = r + beta*p
+		 * z = z + alpha*p, r = r - alpha*s, w = w - alpha*u
+		 * and the (r,r) and (w,r) of the next iteration
+		 * ---------------------------------------------------------------------
+		 */
+		lgamma = 0.0;
+		ldelta = 0.0;
+		#pragma omp for schedule(static) nowait
+		for(j = 0; j < n; j++){
+			pu[j] = q[j] + beta*pu[j];
+			ps[j] = w[j] + beta*ps[j];
+			p[j] = r[j] + beta*p[j];
+			z[j] += alpha*p[j];
+			r[j] -= alpha*ps[j];
+			wnext[j] = w[j] - alpha*pu[j];
+			lgamma += r[j]*r[j];
+			ldelta += wnext[j]*r[j];
+		}
+		slot = (cgit & 1) * PIPE_PAD;
+		pipe_partial[tid*2*PIPE_PAD+slot] = lgamma;
+		pipe_partial[tid*2*PIPE_PAD+slot+1] = ldelta;
+		#pragma omp barrier
+
+		tmp = w;
+		w = wnext;
+		wnext = tmp;
+		alpha_old = alpha;
+		gamma_old = gamma;
+	} /* end of do cgit=1, cgitmax */
+
+	/*
+	 * ---------------------------------------------------------------------
+	 * compute residual norm explicitly: ||r|| = ||x - A.z||
+	 * ---------------------------------------------------------------------
+	 */
+	if(use_sell){
+		sell_spmv(z, r);
+	}else{
+		#pragma omp for nowait
+		for(j = 0; j < lastrow - firstrow + 1; j++){
+			suml = 0.0;
+			for(k = rowstr[j]; k < rowstr[j+1]; k++){
+				suml += a[k]*z[colidx[k]];
+			}
+			r[j] = suml;
+		}
+	}
+	#pragma omp for reduction(+:sum)
+	for(j = 0; j < lastcol-firstcol+1; j++){
+		suml   = x[j] - r[j];
+		sum += suml*suml;
+	}
+	#pragma omp single
+		*rnorm = sqrt(sum);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * build the SELL-C-sigma copy of the CSR matrix (see SELL_C). column
+ * indexes are shifted to local as in main. padding elements are zeros
+ * that point at the last column of their row
+ * ---------------------------------------------------------------------
+ */
+static void build_sell(int colidx[],
+		int rowstr[],
+		double a[],
+		int nrows){
+	int i, j, l, s;
+	int nperm = ((nrows + SELL_C - 1) / SELL_C) * SELL_C;
+	sell_nslices = nperm / SELL_C;
+	sell_perm = (int*)malloc(sizeof(int)*nperm);
+	sell_sliceptr = (int*)malloc(sizeof(int)*(sell_nslices+1));
+
+	/* sort the rows of each window by decreasing length */
+	for(i = 0; i < nperm; i++){
+		sell_perm[i] = (i < nrows) ? i : -1;
+	}
+	for(i = 0; i < nrows; i += SELL_SIGMA){
+		int end = min(i + SELL_SIGMA, nrows);
+		std::stable_sort(sell_perm + i, sell_perm + end, [rowstr](int u, int v){
+			return rowstr[u+1] - rowstr[u] > rowstr[v+1] - rowstr[v];
+		});
+	}
+
+	/* slice offsets: each slice is SELL_C times its longest row */
+	sell_sliceptr[0] = 0;
+	for(s = 0; s < sell_nslices; s++){
+		int len = 0;
+		for(l = 0; l < SELL_C; l++){
+			int row = sell_perm[s*SELL_C+l];
+			if(row >= 0){len = max(len, rowstr[row+1] - rowstr[row]);}
+		}
+		sell_sliceptr[s+1] = sell_sliceptr[s] + len * SELL_C;
+	}
+	sell_col = (int*)malloc(sizeof(int)*(sell_sliceptr[sell_nslices]+1));
+	sell_val = (double*)malloc(sizeof(double)*(sell_sliceptr[sell_nslices]+1));
+
+	#pragma omp parallel for private(j,l)
+	for(s = 0; s < sell_nslices; s++){
+		int len = (sell_sliceptr[s+1] - sell_sliceptr[s]) / SELL_C;
+		for(l = 0; l < SELL_C; l++){
+			int row = sell_perm[s*SELL_C+l];
+			int k = (row >= 0) ? rowstr[row] : 0;
+			int rowlen = (row >= 0) ? rowstr[row+1] - rowstr[row] : 0;
+			int pad = (rowlen > 0) ? colidx[k+rowlen-1] - firstcol : 0;
+			for(j = 0; j < len; j++){
+				int e = sell_sliceptr[s] + j*SELL_C + l;
+				if(j < rowlen){
+					sell_col[e] = colidx[k+j] - firstcol;
+					sell_val[e] = a[k+j];
+				}else{
+					sell_col[e] = pad;
+					sell_val[e] = 0.0;
+				}
+			}
+		}
+	}
+	printf(" SpMV format: SELL-%d-%d, fill %.3f\n", SELL_C, SELL_SIGMA,
+			(double)sell_sliceptr[sell_nslices] / (double)max(rowstr[nrows] - rowstr[0], 1));
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * w = A.v on the SELL-C-sigma copy, called inside the parallel region.
+ * rows are permuted, so unlike the CSR loop it ends with a barrier
+ * before w is read by the following loops
+ * ---------------------------------------------------------------------
+ */
+static void sell_spmv(const double v[],
+		double w[]){
+	int s, j, l;
+	#pragma omp for schedule(dynamic, 16)
+	for(s = 0; s < sell_nslices; s++){
+		const int* col = sell_col + sell_sliceptr[s];
+		const double* val = sell_val + sell_sliceptr[s];
+		int len = (sell_sliceptr[s+1] - sell_sliceptr[s]) / SELL_C;
+		double sum[SELL_C];
+#if defined(__AVX512F__)
+		__m512d acc = _mm512_setzero_pd();
+		for(j = 0; j < len; j++){
+			__m256i idx = _mm256_loadu_si256((const __m256i*)(col + j*SELL_C));
+			__m512d pv = _mm512_i32gather_pd(idx, v, 8);
+			acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_loadu_pd(val + j*SELL_C), pv));
+		}
+		_mm512_storeu_pd(sum, acc);
+#elif defined(__AVX2__)
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		for(j = 0; j < len; j++){
+			__m128i idx0 = _mm_loadu_si128((const __m128i*)(col + j*SELL_C));
+			__m128i idx1 = _mm_loadu_si128((const __m128i*)(col + j*SELL_C + 4));
+			acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(val + j*SELL_C),
+						_mm256_i32gather_pd(v, idx0, 8)));
+			acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(val + j*SELL_C + 4),
+						_mm256_i32gather_pd(v, idx1, 8)));
+		}
+		_mm256_storeu_pd(sum, acc0);
+		_mm256_storeu_pd(sum + 4, acc1);
+#else
+		for(l = 0; l < SELL_C; l++){sum[l] = 0.0;}
+		for(j = 0; j < len; j++){
+			#pragma omp simd
+			for(l = 0; l < SELL_C; l++){
+				sum[l] += val[j*SELL_C+l] * v[col[j*SELL_C+l]];
+			}
+		}
+#endif
+		for(l = 0; l < SELL_C; l++){
+			int row = sell_perm[s*SELL_C+l];
+			if(row >= 0){w[row] = sum[l];}
+		}
+	}
+}
+
 /*
  * ---------------------------------------------------------------------
  * scale a double precision number x in (0,1) by a power of 2 and chop it
@@ -311,6 +311,7 @@ int main(int argc, char **argv)
 			0,
 			nit,
 			tm,
+			0,
 			Mops,
 			(char*)"Random numbers generated",
 			verified,
@@ -330,11 +331,11 @@ int main(int argc, char **argv)
 	if(timers_enabled){
 		if(tm <= 0.0){tm = 1.0;}
 		tt = timer_read(0);
-		printf("\nTotal time:     %9.3f (%6.2f)\n", tt, tt*100.0/tm);
+		printf("\nTotal time:     %9.3f (%6.2f) %10.3f J %8.2f W\n", tt, tt*100.0/tm, timer_read_energy(0), timer_read_power(0));
 		tt = timer_read(1);
-		printf("Gaussian pairs: %9.3f (%6.2f)\n", tt, tt*100.0/tm);
+		printf("Gaussian pairs: %9.3f (%6.2f) %10.3f J %8.2f W\n", tt, tt*100.0/tm, timer_read_energy(1), timer_read_power(1));
 		tt = timer_read(2);
-		printf("Random numbers: %9.3f (%6.2f)\n", tt, tt*100.0/tm);
+		printf("Random numbers: %9.3f (%6.2f) %10.3f J %8.2f W\n", tt, tt*100.0/tm, timer_read_energy(2), timer_read_power(2));
 	}
 
 	//Hiago MGA Rocha (24/11/2021)
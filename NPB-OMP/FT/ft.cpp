@@ -56,9 +56,13 @@ Authors of the OpenMP code:
 */
 
 #include "omp.h"
+#include <cstring>
 #include "../common/npb-CPP.hpp"
 #include "npbparams.hpp"
 #include "../common/rapl.h" //Hiago MGA Rocha (24/11/2021)
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 /*
  * ---------------------------------------------------------------------
@@ -123,6 +127,17 @@ Authors of the OpenMP code:
 #define	FFTBLOCKPAD_DEFAULT DEFAULT_BEHAVIOR
 #define FFTBLOCK FFTBLOCK_DEFAULT
 #define FFTBLOCKPAD FFTBLOCKPAD_DEFAULT
+/*
+ * ---------------------------------------------------------------------
+ * radix-4 FFT core, used when FT_FFT=radix4. FFT4_BATCH lines are
+ * transformed together with their real and imaginary parts in separate
+ * arrays, element i of line j at [i*FFT4_BATCH+j], so every butterfly
+ * is a unit-stride loop over the batch. the two work buffers take
+ * 32*FFT4_BATCH bytes per point, 256 KB for the 512-point lines of
+ * class C, which keeps a batch in L2
+ * ---------------------------------------------------------------------
+ */
+#define FFT4_BATCH 16
 #define	SEED 314159265.0
 #define	A 1220703125.0
 #define	PI 3.141592653589793238
@@ -142,6 +157,7 @@ Authors of the OpenMP code:
 static dcomplex sums[NITER_DEFAULT+1];
 static double twiddle[NTOTAL];
 static dcomplex u[MAXDIM];
+static double u4[6*MAXDIM];
 static dcomplex u0[NTOTAL];
 static dcomplex u1[NTOTAL];
 static int dims[3];
@@ -149,6 +165,7 @@ static int dims[3];
 static dcomplex (*sums)=(dcomplex*)malloc(sizeof(dcomplex)*(NITER_DEFAULT+1));
 static double (*twiddle)=(double*)malloc(sizeof(double)*(NTOTAL));
 static dcomplex (*u)=(dcomplex*)malloc(sizeof(dcomplex)*(MAXDIM));
+static double (*u4)=(double*)malloc(sizeof(double)*(6*MAXDIM));
 static dcomplex (*u0)=(dcomplex*)malloc(sizeof(dcomplex)*(NTOTAL));
 static dcomplex (*u1)=(dcomplex*)malloc(sizeof(dcomplex)*(NTOTAL));
 static int (*dims)=(int*)malloc(sizeof(int)*(3));
@@ -156,6 +173,9 @@ static int (*dims)=(int*)malloc(sizeof(int)*(3));
 static int niter;
 static boolean timers_enabled;
 static boolean debug;
+static boolean use_fft4;
+static double* fft4_buf;
+#pragma omp threadprivate(fft4_buf)
 
 /* function prototypes */
 static void cffts1(int is,
@@ -187,6 +207,13 @@ static void cfftz(int is,
 		int n,
 		dcomplex x[][FFTBLOCKPAD],
 		dcomplex y[][FFTBLOCKPAD]);
+static void cfftz4(int is,
+		int m,
+		int n,
+		double xr[],
+		double xi[],
+		double yr[],
+		double yi[]);
 static void checksum(int i,
 		void* pointer_u1,
 		int d1,
@@ -219,6 +246,14 @@ static void fftz2(int is,
 		dcomplex u[],
 		dcomplex x[][FFTBLOCKPAD],
 		dcomplex y[][FFTBLOCKPAD]);
+static void fftz4(int is,
+		int l,
+		int m,
+		int n,
+		const double xr[],
+		const double xi[],
+		double yr[],
+		double yi[]);
 static int ilog2(int n);
 static void init_ui(void* pointer_u0,
 		void* pointer_u1,
@@ -369,6 +404,7 @@ int main(int argc, char **argv)
 			NZ,
 			niter,
 			total_time,
+			T_TOTAL,
 			mflops,
 			(char*)"          floating point",
 			verified,
@@ -419,6 +455,29 @@ static void cffts1(int is,
 			timer_start(T_FFTX);
 	}
 
+	if(use_fft4){
+		double* xr = fft4_buf;
+		double* xi = xr + d1*FFT4_BATCH;
+		double* yr = xi + d1*FFT4_BATCH;
+		double* yi = yr + d1*FFT4_BATCH;
+		#pragma omp for
+		for(k=0; k<d3; k++){
+			for(jj=0; jj<d2; jj+=FFT4_BATCH){
+				for(j=0; j<FFT4_BATCH; j++){
+					for(i=0; i<d1; i++){
+						xr[i*FFT4_BATCH+j] = x[k][j+jj][i].real;
+						xi[i*FFT4_BATCH+j] = x[k][j+jj][i].imag;
+					}
+				}
+				cfftz4(is, logd1, d1, xr, xi, yr, yi);
+				for(j=0; j<FFT4_BATCH; j++){
+					for(i=0; i<d1; i++){
+						xout[k][j+jj][i] = dcomplex_create(xr[i*FFT4_BATCH+j], xi[i*FFT4_BATCH+j]);
+					}
+				}
+			}
+		}
+	}else{
 	#pragma omp for
 	for(k=0; k<d3; k++){
 		for(jj=0; jj<=d2-FFTBLOCK; jj+=FFTBLOCK){
@@ -435,6 +494,7 @@ static void cffts1(int is,
 			}
 		}
 	}
+	}
 
 	if(timers_enabled){
 		#pragma omp master
@@ -463,6 +523,29 @@ static void cffts2(int is,
 			timer_start(T_FFTY);
 	}
 
+	if(use_fft4){
+		double* xr = fft4_buf;
+		double* xi = xr + d2*FFT4_BATCH;
+		double* yr = xi + d2*FFT4_BATCH;
+		double* yi = yr + d2*FFT4_BATCH;
+		#pragma omp for
+		for(k=0; k<d3; k++){
+			for(ii=0; ii<d1; ii+=FFT4_BATCH){
+				for(j=0; j<d2; j++){
+					for(i=0; i<FFT4_BATCH; i++){
+						xr[j*FFT4_BATCH+i] = x[k][j][i+ii].real;
+						xi[j*FFT4_BATCH+i] = x[k][j][i+ii].imag;
+					}
+				}
+				cfftz4(is, logd2, d2, xr, xi, yr, yi);
+				for(j=0; j<d2; j++){
+					for(i=0; i<FFT4_BATCH; i++){
+						xout[k][j][i+ii] = dcomplex_create(xr[j*FFT4_BATCH+i], xi[j*FFT4_BATCH+i]);
+					}
+				}
+			}
+		}
+	}else{
 	#pragma omp for
 	for(k=0; k<d3; k++){
 		for(ii=0; ii<=d1-FFTBLOCK; ii+=FFTBLOCK){
@@ -479,6 +562,7 @@ static void cffts2(int is,
 			}
 		}
 	}
+	}
 
 	if(timers_enabled){
 		#pragma omp master
@@ -507,6 +591,29 @@ static void cffts3(int is,
 			timer_start(T_FFTZ);
 	}
 
+	if(use_fft4){
+		double* xr = fft4_buf;
+		double* xi = xr + d3*FFT4_BATCH;
+		double* yr = xi + d3*FFT4_BATCH;
+		double* yi = yr + d3*FFT4_BATCH;
+		#pragma omp for
+		for(j=0; j<d2; j++){
+			for(ii=0; ii<d1; ii+=FFT4_BATCH){
+				for(k=0; k<d3; k++){
+					for(i=0; i<FFT4_BATCH; i++){
+						xr[k*FFT4_BATCH+i] = x[k][j][i+ii].real;
+						xi[k*FFT4_BATCH+i] = x[k][j][i+ii].imag;
+					}
+				}
+				cfftz4(is, logd3, d3, xr, xi, yr, yi);
+				for(k=0; k<d3; k++){
+					for(i=0; i<FFT4_BATCH; i++){
+						xout[k][j][i+ii] = dcomplex_create(xr[k*FFT4_BATCH+i], xi[k*FFT4_BATCH+i]);
+					}
+				}
+			}
+		}
+	}else{
 	#pragma omp for
 	for(j=0; j<d2; j++){
 		for(ii=0; ii<=d1-FFTBLOCK; ii+=FFTBLOCK){
@@ -523,6 +630,7 @@ static void cffts3(int is,
 			}
 		}
 	}
+	}
 
 	if(timers_enabled){
 		#pragma omp master
@@ -583,6 +691,53 @@ static void cfftz(int is,
 	}
 }
 
+/*
+ * ---------------------------------------------------------------------
+ * radix-4 counterpart of cfftz: FFT4_BATCH N-point FFTs of the batch
+ * (xr, xi), which holds the result on return; (yr, yi) is scratch. each
+ * pass of fftz4 does the work of two fftz2 iterations, and an odd M
+ * ends with one radix-2 pass
+ * ---------------------------------------------------------------------
+ */
+static void cfftz4(int is,
+		int m,
+		int n,
+		double xr[],
+		double xi[],
+		double yr[],
+		double yi[]){
+	int l, k, h, len;
+	double *sr, *si, *dr, *di, *t;
+
+	sr = xr; si = xi;
+	dr = yr; di = yi;
+	for(l=1; l+1<=m; l+=2){
+		fftz4(is, l, m, n, sr, si, dr, di);
+		t = sr; sr = dr; dr = t;
+		t = si; si = di; di = t;
+	}
+	if(l==m){
+		/* last stage of an odd M: twiddles are all 1 */
+		h = n / 2 * FFT4_BATCH;
+		#pragma omp simd
+		for(k=0; k<h; k++){
+			double ar = sr[k], ai = si[k];
+			double br = sr[k+h], bi = si[k+h];
+			dr[k] = ar + br;
+			di[k] = ai + bi;
+			dr[k+h] = ar - br;
+			di[k+h] = ai - bi;
+		}
+		t = sr; sr = dr; dr = t;
+		t = si; si = di; di = t;
+	}
+	if(sr != xr){
+		len = n * FFT4_BATCH;
+		memcpy(xr, sr, sizeof(double)*len);
+		memcpy(xi, si, sizeof(double)*len);
+	}
+}
+
 static void checksum(int i,
 		void* pointer_u1,
 		int d1,
@@ -734,6 +889,10 @@ static void fft(int dir,
 	dcomplex y1[MAXDIM*FFTBLOCKPAD];
 	dcomplex y2[MAXDIM*FFTBLOCKPAD];
 
+	if(use_fft4 && fft4_buf == NULL){
+		fft4_buf = (double*)aligned_alloc(64, sizeof(double)*4*MAXDIM*FFT4_BATCH);
+	}
+
 	/*
 	 * ---------------------------------------------------------------------
 	 * note: args x1, x2 must be different arrays
@@ -796,6 +955,27 @@ static void fft_init(int n){
 		ku = ku + ln;
 		ln = 2 * ln;
 	}
+
+	/*
+	 * ---------------------------------------------------------------------
+	 * twiddles of the radix-4 passes, for the pass with q = n/(4*lk)
+	 * groups at [q+i]: w1 = u[2q+i], w2 = u[q+i] = w1^2 and w3 = w1*w2,
+	 * real and imaginary parts in separate rows of u4
+	 * ---------------------------------------------------------------------
+	 */
+	for(ln=1; 4*ln<=n; ln*=2){
+		for(i=0; i<ln; i++){
+			dcomplex w1 = u[2*ln+i];
+			dcomplex w2 = u[ln+i];
+			dcomplex w3 = dcomplex_mul(w1, w2);
+			u4[0*MAXDIM+ln+i] = w1.real;
+			u4[1*MAXDIM+ln+i] = w1.imag;
+			u4[2*MAXDIM+ln+i] = w2.real;
+			u4[3*MAXDIM+ln+i] = w2.imag;
+			u4[4*MAXDIM+ln+i] = w3.real;
+			u4[5*MAXDIM+ln+i] = w3.imag;
+		}
+	}
 }
 
 /*
@@ -853,6 +1033,129 @@ static void fftz2(int is,
 	}
 }
 
+/*
+ * ---------------------------------------------------------------------
+ * performs iterations l and l+1 of the stockham FFT of fftz2 as one
+ * radix-4 pass on a batch. for group i the four inputs are a quarter
+ * of the line apart and the outputs lk apart; with k and the batch
+ * line merged, each group is one contiguous run of lk*FFT4_BATCH
+ * elements, a multiple of the vector width
+ * ---------------------------------------------------------------------
+ */
+static void fftz4(int is,
+		int l,
+		int m,
+		int n,
+		const double xr[],
+		const double xi[],
+		double yr[],
+		double yi[]){
+	int i, k, lk, q, len, quarter;
+	double s = (is>=1) ? 1.0 : -1.0;
+
+	lk = 1 << (l - 1);
+	q = 1 << (m - l - 1);
+	len = lk * FFT4_BATCH;
+	quarter = q * len;
+
+	for(i=0; i<q; i++){
+		double w1r = u4[0*MAXDIM+q+i], w1i = s*u4[1*MAXDIM+q+i];
+		double w2r = u4[2*MAXDIM+q+i], w2i = s*u4[3*MAXDIM+q+i];
+		double w3r = u4[4*MAXDIM+q+i], w3i = s*u4[5*MAXDIM+q+i];
+		const double *a0r = xr + i*len, *a0i = xi + i*len;
+		const double *a1r = a0r + quarter, *a1i = a0i + quarter;
+		const double *a2r = a1r + quarter, *a2i = a1i + quarter;
+		const double *a3r = a2r + quarter, *a3i = a2i + quarter;
+		double *b0r = yr + 4*i*len, *b0i = yi + 4*i*len;
+		double *b1r = b0r + len, *b1i = b0i + len;
+		double *b2r = b1r + len, *b2i = b1i + len;
+		double *b3r = b2r + len, *b3i = b2i + len;
+#if defined(__AVX512F__)
+		{
+			__m512d vs = _mm512_set1_pd(s);
+			__m512d vw1r = _mm512_set1_pd(w1r), vw1i = _mm512_set1_pd(w1i);
+			__m512d vw2r = _mm512_set1_pd(w2r), vw2i = _mm512_set1_pd(w2i);
+			__m512d vw3r = _mm512_set1_pd(w3r), vw3i = _mm512_set1_pd(w3i);
+			for(k=0; k<len; k+=8){
+				__m512d x0r = _mm512_loadu_pd(a0r+k), x0i = _mm512_loadu_pd(a0i+k);
+				__m512d x1r = _mm512_loadu_pd(a1r+k), x1i = _mm512_loadu_pd(a1i+k);
+				__m512d x2r = _mm512_loadu_pd(a2r+k), x2i = _mm512_loadu_pd(a2i+k);
+				__m512d x3r = _mm512_loadu_pd(a3r+k), x3i = _mm512_loadu_pd(a3i+k);
+				__m512d t0r = _mm512_add_pd(x0r, x2r), t0i = _mm512_add_pd(x0i, x2i);
+				__m512d t1r = _mm512_add_pd(x1r, x3r), t1i = _mm512_add_pd(x1i, x3i);
+				__m512d d0r = _mm512_sub_pd(x0r, x2r), d0i = _mm512_sub_pd(x0i, x2i);
+				/* d1 = s*i*(x1-x3) */
+				__m512d d1r = _mm512_mul_pd(vs, _mm512_sub_pd(x3i, x1i));
+				__m512d d1i = _mm512_mul_pd(vs, _mm512_sub_pd(x1r, x3r));
+				__m512d cr, ci;
+				_mm512_storeu_pd(b0r+k, _mm512_add_pd(t0r, t1r));
+				_mm512_storeu_pd(b0i+k, _mm512_add_pd(t0i, t1i));
+				cr = _mm512_sub_pd(t0r, t1r); ci = _mm512_sub_pd(t0i, t1i);
+				_mm512_storeu_pd(b2r+k, _mm512_fmsub_pd(vw2r, cr, _mm512_mul_pd(vw2i, ci)));
+				_mm512_storeu_pd(b2i+k, _mm512_fmadd_pd(vw2r, ci, _mm512_mul_pd(vw2i, cr)));
+				cr = _mm512_add_pd(d0r, d1r); ci = _mm512_add_pd(d0i, d1i);
+				_mm512_storeu_pd(b1r+k, _mm512_fmsub_pd(vw1r, cr, _mm512_mul_pd(vw1i, ci)));
+				_mm512_storeu_pd(b1i+k, _mm512_fmadd_pd(vw1r, ci, _mm512_mul_pd(vw1i, cr)));
+				cr = _mm512_sub_pd(d0r, d1r); ci = _mm512_sub_pd(d0i, d1i);
+				_mm512_storeu_pd(b3r+k, _mm512_fmsub_pd(vw3r, cr, _mm512_mul_pd(vw3i, ci)));
+				_mm512_storeu_pd(b3i+k, _mm512_fmadd_pd(vw3r, ci, _mm512_mul_pd(vw3i, cr)));
+			}
+		}
+#elif defined(__AVX2__)
+		{
+			__m256d vs = _mm256_set1_pd(s);
+			__m256d vw1r = _mm256_set1_pd(w1r), vw1i = _mm256_set1_pd(w1i);
+			__m256d vw2r = _mm256_set1_pd(w2r), vw2i = _mm256_set1_pd(w2i);
+			__m256d vw3r = _mm256_set1_pd(w3r), vw3i = _mm256_set1_pd(w3i);
+			for(k=0; k<len; k+=4){
+				__m256d x0r = _mm256_loadu_pd(a0r+k), x0i = _mm256_loadu_pd(a0i+k);
+				__m256d x1r = _mm256_loadu_pd(a1r+k), x1i = _mm256_loadu_pd(a1i+k);
+				__m256d x2r = _mm256_loadu_pd(a2r+k), x2i = _mm256_loadu_pd(a2i+k);
+				__m256d x3r = _mm256_loadu_pd(a3r+k), x3i = _mm256_loadu_pd(a3i+k);
+				__m256d t0r = _mm256_add_pd(x0r, x2r), t0i = _mm256_add_pd(x0i, x2i);
+				__m256d t1r = _mm256_add_pd(x1r, x3r), t1i = _mm256_add_pd(x1i, x3i);
+				__m256d d0r = _mm256_sub_pd(x0r, x2r), d0i = _mm256_sub_pd(x0i, x2i);
+				/* d1 = s*i*(x1-x3) */
+				__m256d d1r = _mm256_mul_pd(vs, _mm256_sub_pd(x3i, x1i));
+				__m256d d1i = _mm256_mul_pd(vs, _mm256_sub_pd(x1r, x3r));
+				__m256d cr, ci;
+				_mm256_storeu_pd(b0r+k, _mm256_add_pd(t0r, t1r));
+				_mm256_storeu_pd(b0i+k, _mm256_add_pd(t0i, t1i));
+				cr = _mm256_sub_pd(t0r, t1r); ci = _mm256_sub_pd(t0i, t1i);
+				_mm256_storeu_pd(b2r+k, _mm256_sub_pd(_mm256_mul_pd(vw2r, cr), _mm256_mul_pd(vw2i, ci)));
+				_mm256_storeu_pd(b2i+k, _mm256_add_pd(_mm256_mul_pd(vw2r, ci), _mm256_mul_pd(vw2i, cr)));
+				cr = _mm256_add_pd(d0r, d1r); ci = _mm256_add_pd(d0i, d1i);
+				_mm256_storeu_pd(b1r+k, _mm256_sub_pd(_mm256_mul_pd(vw1r, cr), _mm256_mul_pd(vw1i, ci)));
+				_mm256_storeu_pd(b1i+k, _mm256_add_pd(_mm256_mul_pd(vw1r, ci), _mm256_mul_pd(vw1i, cr)));
+				cr = _mm256_sub_pd(d0r, d1r); ci = _mm256_sub_pd(d0i, d1i);
+				_mm256_storeu_pd(b3r+k, _mm256_sub_pd(_mm256_mul_pd(vw3r, cr), _mm256_mul_pd(vw3i, ci)));
+				_mm256_storeu_pd(b3i+k, _mm256_add_pd(_mm256_mul_pd(vw3r, ci), _mm256_mul_pd(vw3i, cr)));
+			}
+		}
+#else
+		#pragma omp simd
+		for(k=0; k<len; k++){
+			double t0r = a0r[k] + a2r[k], t0i = a0i[k] + a2i[k];
+			double t1r = a1r[k] + a3r[k], t1i = a1i[k] + a3i[k];
+			double d0r = a0r[k] - a2r[k], d0i = a0i[k] - a2i[k];
+			double d1r = s * (a3i[k] - a1i[k]), d1i = s * (a1r[k] - a3r[k]);
+			double cr, ci;
+			b0r[k] = t0r + t1r;
+			b0i[k] = t0i + t1i;
+			cr = t0r - t1r; ci = t0i - t1i;
+			b2r[k] = w2r*cr - w2i*ci;
+			b2i[k] = w2r*ci + w2i*cr;
+			cr = d0r + d1r; ci = d0i + d1i;
+			b1r[k] = w1r*cr - w1i*ci;
+			b1i[k] = w1r*ci + w1i*cr;
+			cr = d0r - d1r; ci = d0i - d1i;
+			b3r[k] = w3r*cr - w3i*ci;
+			b3i[k] = w3r*ci + w3i*cr;
+		}
+#endif
+	}
+}
+
 static int ilog2(int n){
 	int nn, lg;
 	if(n==1){return 0;}
@@ -948,8 +1251,8 @@ static void print_timers(){
 	if(t_m <= 0.0){t_m = 1.00;}
 	for(i = 1; i <= T_MAX; i++){
 		t = timer_read(i);
-		printf(" timer %2d(%16s) :%9.4f (%6.2f%%)\n",
-				i, tstrings[i], t, t*100.0/t_m);
+		printf(" timer %2d(%16s) :%9.4f (%6.2f%%) %10.3f J %8.2f W\n",
+				i, tstrings[i], t, t*100.0/t_m, timer_read_energy(i), timer_read_power(i));
 	}
 }
 
@@ -969,6 +1272,18 @@ static void setup(){
 	printf("\n\n NAS Parallel Benchmarks 4.1 Parallel C++ version with OpenMP - FT Benchmark\n\n");
 	printf(" Size                : %4dx%4dx%4d\n", NX, NY, NZ);
 	printf(" Iterations                  :%7d\n", niter);
+
+	char* fft_core = std::getenv("FT_FFT");
+	use_fft4 = (fft_core != NULL && strcmp(fft_core, "radix4") == 0);
+	if(use_fft4 && (NX%FFT4_BATCH != 0 || NY%FFT4_BATCH != 0)){
+		printf(" FT_FFT=radix4 needs dimensions that are multiples of %d\n", FFT4_BATCH);
+		use_fft4 = FALSE;
+	}
+	if(use_fft4){
+		printf(" FFT core: radix-4 SoA, %d lines per batch\n", FFT4_BATCH);
+	}else{
+		printf(" FFT core: radix-2 Stockham\n");
+	}
 	printf("\n");
 
 	dims[0] = NX;
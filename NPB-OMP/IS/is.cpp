@@ -338,6 +338,7 @@ int main(int argc, char** argv)
 			0,
 			MAX_ITERATIONS,
 			timecounter,
+			T_BENCHMARKING,
 			((double)(MAX_ITERATIONS*TOTAL_KEYS))/timecounter/1000000.0,
 			(char*)"keys ranked",
 			passed_verification,
@@ -359,17 +360,21 @@ int main(int argc, char** argv)
 		double t_total, t_percent;
 		t_total = timer_read( T_TOTAL_EXECUTION );
 		printf("\nAdditional timers -\n");
-		printf(" Total execution: %8.3f\n", t_total);
+		printf(" Total execution: %8.3f          %10.3f J %8.2f W\n", t_total,
+				timer_read_energy(T_TOTAL_EXECUTION), timer_read_power(T_TOTAL_EXECUTION));
 		if (t_total == 0.0) t_total = 1.0;
 		timecounter = timer_read(T_INITIALIZATION);
 		t_percent = timecounter/t_total * 100.;
-		printf(" Initialization : %8.3f (%5.2f%%)\n", timecounter, t_percent);
+		printf(" Initialization : %8.3f (%5.2f%%) %10.3f J %8.2f W\n", timecounter, t_percent,
+				timer_read_energy(T_INITIALIZATION), timer_read_power(T_INITIALIZATION));
 		timecounter = timer_read(T_BENCHMARKING);
 		t_percent = timecounter/t_total * 100.;
-		printf(" Benchmarking   : %8.3f (%5.2f%%)\n", timecounter, t_percent);
+		printf(" Benchmarking   : %8.3f (%5.2f%%) %10.3f J %8.2f W\n", timecounter, t_percent,
+				timer_read_energy(T_BENCHMARKING), timer_read_power(T_BENCHMARKING));
 		timecounter = timer_read(T_SORTING);
 		t_percent = timecounter/t_total * 100.;
-		printf(" Sorting        : %8.3f (%5.2f%%)\n", timecounter, t_percent);
+		printf(" Sorting        : %8.3f (%5.2f%%) %10.3f J %8.2f W\n", timecounter, t_percent,
+				timer_read_energy(T_SORTING), timer_read_power(T_SORTING));
 	}
 
 	//Hiago MGA Rocha (24/11/2021)
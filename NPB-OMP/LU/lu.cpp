@@ -363,6 +363,7 @@ int main(int argc, char* argv[])
 			nz0,
 			itmax,
 			maxtime,
+			1,
 			mflops,
 			(char*)"          floating point",
 			verified,
@@ -391,7 +392,8 @@ int main(int argc, char* argv[])
 		if(tmax==0.0){tmax=1.0;}
 		printf("  SECTION     Time (secs)\n");
 		for(i=1; i<=T_LAST; i++){
-			printf("  %-8s:%9.3f  (%6.2f%%)\n",t_names[i],trecs[i],trecs[i]*100./tmax);
+			printf("  %-8s:%9.3f  (%6.2f%%) %10.3f J %8.2f W\n",t_names[i],trecs[i],trecs[i]*100./tmax,
+					timer_read_energy(i),timer_read_power(i));
 			if(i==T_RHS){
 				t=trecs[T_RHSX]+trecs[T_RHSY]+trecs[T_RHSZ];
 				printf("     --> %8s:%9.3f  (%6.2f%%)\n", "sub-rhs",t,t*100./tmax);
@@ -58,6 +58,7 @@ Authors of the OpenMP code:
 */
 
 #include "omp.h"
+#include <cstring>
 #include "../common/npb-CPP.hpp"
 #include "npbparams.hpp"
 #include "../common/rapl.h" //Hiago MGA Rocha (24/11/2021)
@@ -80,7 +81,8 @@ Authors of the OpenMP code:
 #define T_INTERP 7
 #define T_NORM2 8
 #define T_COMM3 9
-#define T_LAST 10
+#define T_FUSED 10
+#define T_LAST 11
 
 /* global variables */
 #if defined(DO_NOT_ALLOCATE_ARRAYS_WITH_DYNAMIC_MEMORY_AND_AS_SINGLE_DIMENSION)
@@ -110,17 +112,24 @@ static double (*r)=(double*)malloc(sizeof(double)*(NR));
 #endif
 static int is1, is2, is3, ie1, ie2, ie3, lt, lb;
 static boolean timeron;
+static boolean use_fused;
 
 /* function prototypes */
 static void bubble(double ten[][MM], int j1[][MM], int j2[][MM], int j3[][MM], int m, int ind);
 static void comm3(void* pointer_u, int n1, int n2, int n3, int kk);
+static void comm3_axis3(void* pointer_u, int n1, int n2, int n3);
+static void copy_plane(void* pointer_u, int n1, int n2, int n3, int to, int from);
 static void interp(void* pointer_z, int mm1, int mm2, int mm3, void* pointer_u, int n1, int n2, int n3, int k);
+static void interp_plane(void* pointer_z, int mm1, int mm2, int mm3, void* pointer_u, int n1, int n2, int n3, int i3, boolean add);
+static void interp_resid_psinv(void* pointer_z, int mm1, int mm2, int mm3, void* pointer_u, void* pointer_v, void* pointer_r, int n1, int n2, int n3, double a[4], double c[4], boolean add, int k);
 static void mg3P(double u[], double v[], double r[], double a[4], double c[4], int n1, int n2, int n3, int k);
 static void norm2u3(void* pointer_r, int n1, int n2, int n3, double* rnm2, double* rnmu, int nx, int ny, int nz);
 static double power(double a, int n);
 static void psinv(void* pointer_r, void* pointer_u, int n1, int n2, int n3, double c[4], int k);
+static void psinv_plane(void* pointer_r, void* pointer_u, int n1, int n2, int n3, double c[4], int i3);
 static void rep_nrm(void* pointer_u, int n1, int n2, int n3, char* title, int kk);
 static void resid(void* pointer_u, void* pointer_v, void* pointer_r, int n1, int n2, int n3, double a[4], int k);
+static void resid_plane(void* pointer_u, void* pointer_v, void* pointer_r, int n1, int n2, int n3, double a[4], int i3);
 static void rprj3(void* pointer_r, int m1k, int m2k, int m3k, void* pointer_s, int m1j, int m2j, int m3j, int k);
 static void setup(int* n1, int* n2, int* n3, int k);
 static void showall(void* pointer_z, int n1, int n2, int n3);
@@ -180,10 +189,13 @@ int main(int argc, char *argv[])
 		t_names[T_INTERP] = (char*) "interp";
 		t_names[T_NORM2] = (char*) "norm2";
 		t_names[T_COMM3] = (char*) "comm3";
+		t_names[T_FUSED] = (char*) "fused";
 		fclose(fp);
 	}else{
 		timeron = FALSE;
 	}
+	char* vcycle = std::getenv("MG_VCYCLE");
+	use_fused = (vcycle != NULL && strcmp(vcycle, "fused") == 0);
 	fp = fopen("mg.input", "r");
 	if(fp != NULL){
 		printf(" Reading from input file mg.input\n");
@@ -289,6 +301,11 @@ int main(int argc, char *argv[])
 	printf("\n\n NAS Parallel Benchmarks 4.1 Parallel C++ version with OpenMP - MG Benchmark\n\n");
 	printf(" Size: %3dx%3dx%3d (class_npb %1c)\n", nx[lt], ny[lt], nz[lt], class_npb);
 	printf(" Iterations: %3d\n", nit);
+	if(use_fused){
+		printf(" V-cycle: fused interp/resid/psinv\n");
+	}else{
+		printf(" V-cycle: standard\n");
+	}
 
 	start_rapl_sysfs(); //Hiago MGA Rocha (24/11/2021)
 
@@ -433,6 +450,7 @@ int main(int argc, char *argv[])
 			nz[lt],
 			nit,
 			t,
+			T_BENCH,
 			mflops,
 			(char*)"          floating point",
 			verified,
@@ -464,7 +482,8 @@ int main(int argc, char *argv[])
 				t = timer_read(T_RESID) - t;
 				printf("    --> %8s:%9.3f  (%6.2f%%)\n", "mg-resid", t, t*100.0/tmax);
 			}else{
-				printf("  %-8s:%9.3f  (%6.2f%%)\n", t_names[i], t, t*100.0/tmax);
+				printf("  %-8s:%9.3f  (%6.2f%%) %10.3f J %8.2f W\n", t_names[i], t, t*100.0/tmax,
+						timer_read_energy(i), timer_read_power(i));
 			}
 		}
 	}
@@ -582,6 +601,59 @@ static void comm3(void* pointer_u, int n1, int n2, int n3, int kk){
 	}
 }
 
+/*
+ * ---------------------------------------------------------------------
+ * axis 3 part of comm3, for the fused v-cycle whose plane routines
+ * already exchange axes 1 and 2 as they finish each plane
+ * ---------------------------------------------------------------------
+ */
+static void comm3_axis3(void* pointer_u, int n1, int n2, int n3){
+#ifdef __clang__
+		using custom_cast = double (*)[n2][n1];
+		custom_cast u = reinterpret_cast<custom_cast>(pointer_u);
+#else
+		double (*u)[n2][n1] = (double (*)[n2][n1])pointer_u;
+#endif
+
+	int i1, i2;
+	if(timeron){
+		#pragma omp master
+			timer_start(T_COMM3);
+	}
+	#pragma omp for
+	for(i2 = 0; i2 < n2; i2++){
+		for(i1 = 0; i1 < n1; i1++){
+			u[0][i2][i1] = u[n3-2][i2][i1];
+			u[n3-1][i2][i1] = u[1][i2][i1];
+		}
+	}
+	if(timeron){
+		#pragma omp master
+			timer_stop(T_COMM3);
+	}
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * copies plane from of u, ghost cells included, to plane to
+ * ---------------------------------------------------------------------
+ */
+static void copy_plane(void* pointer_u, int n1, int n2, int n3, int to, int from){
+#ifdef __clang__
+		using custom_cast = double (*)[n2][n1];
+		custom_cast u = reinterpret_cast<custom_cast>(pointer_u);
+#else
+		double (*u)[n2][n1] = (double (*)[n2][n1])pointer_u;
+#endif
+
+	int i1, i2;
+	for(i2 = 0; i2 < n2; i2++){
+		for(i1 = 0; i1 < n1; i1++){
+			u[to][i2][i1] = u[from][i2][i1];
+		}
+	}
+}
+
 /*
  * --------------------------------------------------------------------
  * interp adds the trilinear interpolation of the correction
@@ -757,6 +829,145 @@ static void interp(void* pointer_z, int mm1, int mm2, int mm3, void* pointer_u,
 	}
 }
 
+/*
+ * --------------------------------------------------------------------
+ * plane i3 of interp (the n1, n2, n3 != 3 case). even planes only use
+ * plane i3/2 of z and odd planes planes i3/2 and i3/2+1, so any plane
+ * can be done on its own. with add false u is set rather than added
+ * to, which stands in for the zero3 before interp
+ * --------------------------------------------------------------------
+ */
+static void interp_plane(void* pointer_z, int mm1, int mm2, int mm3, void* pointer_u, int n1, int n2, int n3, int i3, boolean add){
+#ifdef __clang__
+	using custom_cast = double (*)[mm2][mm1];
+	custom_cast z = reinterpret_cast<custom_cast>(pointer_z);
+	using custom_cast2 = double (*)[n2][n1];
+	custom_cast2 u = reinterpret_cast<custom_cast2>(pointer_u);
+#else
+	double (*z)[mm2][mm1] = (double (*)[mm2][mm1])pointer_z;
+	double (*u)[n2][n1] = (double (*)[n2][n1])pointer_u;
+#endif
+
+	int j3, i2, i1;
+	double z1[M], z2[M], z3[M];
+
+	j3 = i3 / 2;
+	for(i2 = 0; i2 < mm2-1; i2++){
+		for(i1 = 0; i1 < mm1; i1++){
+			z1[i1] = z[j3][i2+1][i1] + z[j3][i2][i1];
+		}
+		if((i3 & 1) == 0){
+			for(i1 = 0; i1 < mm1-1; i1++){
+				u[i3][2*i2][2*i1] = (add ? u[i3][2*i2][2*i1] : 0.0)
+					+z[j3][i2][i1];
+				u[i3][2*i2][2*i1+1] = (add ? u[i3][2*i2][2*i1+1] : 0.0)
+					+0.5*(z[j3][i2][i1+1]+z[j3][i2][i1]);
+			}
+			for(i1 = 0; i1 < mm1-1; i1++){
+				u[i3][2*i2+1][2*i1] = (add ? u[i3][2*i2+1][2*i1] : 0.0)
+					+0.5 * z1[i1];
+				u[i3][2*i2+1][2*i1+1] = (add ? u[i3][2*i2+1][2*i1+1] : 0.0)
+					+0.25*( z1[i1] + z1[i1+1] );
+			}
+		}else{
+			for(i1 = 0; i1 < mm1; i1++){
+				z2[i1] = z[j3+1][i2][i1] + z[j3][i2][i1];
+				z3[i1] = z[j3+1][i2+1][i1] + z[j3+1][i2][i1] + z1[i1];
+			}
+			for(i1 = 0; i1 < mm1-1; i1++){
+				u[i3][2*i2][2*i1] = (add ? u[i3][2*i2][2*i1] : 0.0)
+					+0.5 * z2[i1];
+				u[i3][2*i2][2*i1+1] = (add ? u[i3][2*i2][2*i1+1] : 0.0)
+					+0.25*( z2[i1] + z2[i1+1] );
+			}
+			for(i1 = 0; i1 < mm1-1; i1++){
+				u[i3][2*i2+1][2*i1] = (add ? u[i3][2*i2+1][2*i1] : 0.0)
+					+0.25* z3[i1];
+				u[i3][2*i2+1][2*i1+1] = (add ? u[i3][2*i2+1][2*i1+1] : 0.0)
+					+0.125*( z3[i1] + z3[i1+1] );
+			}
+		}
+	}
+}
+
+/*
+ * --------------------------------------------------------------------
+ * fused v-cycle step, used when MG_VCYCLE=fused: interp, resid and
+ * psinv in one pass over the planes of u instead of three sweeps of
+ * the grid. the interior planes are split into one slab per thread,
+ * and each thread walks its slab as a wavefront, interpolating plane
+ * i3+2, then taking the residual of plane i3+1 and smoothing plane
+ * i3, so the residual is smoothed while its planes are still in
+ * cache and resid only ever reads unsmoothed u. the planes at the
+ * slab edges are shared with the neighbouring slabs: they are
+ * interpolated and have their residual taken in two first steps, each
+ * closed by a barrier. results are the same as zero3 (when add is
+ * false), interp, resid and psinv in turn
+ * --------------------------------------------------------------------
+ */
+static void interp_resid_psinv(void* pointer_z, int mm1, int mm2, int mm3, void* pointer_u, void* pointer_v, void* pointer_r, int n1, int n2, int n3, double a[4], double c[4], boolean add, int k){
+	int i3, lo, hi;
+	int nthreads = omp_get_num_threads();
+	int tid = omp_get_thread_num();
+
+	if(timeron){
+		#pragma omp master
+			timer_start(T_FUSED);
+	}
+
+	lo = 1 + (n3-2) * tid / nthreads;
+	hi = 1 + (n3-2) * (tid+1) / nthreads;
+
+	/* planes at the slab edges, and the ghost planes next to them */
+	if(lo < hi){
+		interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, lo, add);
+		if(hi-1 > lo){interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, hi-1, add);}
+		if(lo == 1){interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, 0, add);}
+		if(hi == n3-1){interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, n3-1, add);}
+	}
+	#pragma omp barrier
+
+	/* residual of the slab edges */
+	if(lo < hi){
+		if(lo+1 < hi-1){interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, lo+1, add);}
+		resid_plane(pointer_u, pointer_v, pointer_r, n1, n2, n3, a, lo);
+		if(hi-1 > lo){
+			if(hi-2 > lo+1){interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, hi-2, add);}
+			resid_plane(pointer_u, pointer_v, pointer_r, n1, n2, n3, a, hi-1);
+		}
+		if(lo == 1){copy_plane(pointer_r, n1, n2, n3, n3-1, 1);}
+		if(hi == n3-1){copy_plane(pointer_r, n1, n2, n3, 0, n3-2);}
+	}
+	#pragma omp barrier
+
+	/* wavefront through the slab */
+	for(i3 = lo; i3 < hi; i3++){
+		if(i3+1 < hi-1){
+			if(i3+2 < hi-2){interp_plane(pointer_z, mm1, mm2, mm3, pointer_u, n1, n2, n3, i3+2, add);}
+			resid_plane(pointer_u, pointer_v, pointer_r, n1, n2, n3, a, i3+1);
+		}
+		psinv_plane(pointer_r, pointer_u, n1, n2, n3, c, i3);
+	}
+	#pragma omp barrier
+
+	if(timeron){
+		#pragma omp master
+			timer_stop(T_FUSED);
+	}
+
+	comm3_axis3(pointer_u, n1, n2, n3);
+
+	if(debug_vec[0] >= 1){
+		#pragma omp single
+			rep_nrm(pointer_u,n1,n2,n3,(char*)"   fused",k);
+	}
+
+	if(debug_vec[3] >= k){
+		#pragma omp single
+			showall(pointer_u,n1,n2,n3);
+	}
+}
+
 /*
  * --------------------------------------------------------------------
  * multigrid v-cycle routine
@@ -792,6 +1003,11 @@ static void mg3P(double u[], double v[], double r[], double a[4], double c[4], i
 		 * prolongate from level k-1  to k
 		 * -------------------------------------------------------------------
 		 */
+		if(use_fused && m1[k] != 3 && m2[k] != 3 && m3[k] != 3){
+			interp_resid_psinv(&u[ir[j]], m1[j], m2[j], m3[j], &u[ir[k]], &r[ir[k]], &r[ir[k]],
+					m1[k], m2[k], m3[k], a, c, FALSE, k);
+			continue;
+		}
 		zero3(&u[ir[k]], m1[k], m2[k], m3[k]);
 		interp(&u[ir[j]], m1[j], m2[j], m3[j], &u[ir[k]], m1[k], m2[k], m3[k], k);
 		/*
@@ -810,6 +1026,10 @@ static void mg3P(double u[], double v[], double r[], double a[4], double c[4], i
 
 	j = lt - 1;
 	k = lt;
+	if(use_fused && n1 != 3 && n2 != 3 && n3 != 3){
+		interp_resid_psinv(&u[ir[j]], m1[j], m2[j], m3[j], u, v, r, n1, n2, n3, a, c, TRUE, k);
+		return;
+	}
 	interp(&u[ir[j]], m1[j], m2[j], m3[j], u, n1, n2, n3, k);
 	resid(u, v, r, n1, n2, n3, a, k);
 	psinv(r, u, n1, n2, n3, c, k);
@@ -974,6 +1194,49 @@ static void psinv(void* pointer_r, void* pointer_u, int n1, int n2, int n3, doub
 	}
 }
 
+/*
+ * --------------------------------------------------------------------
+ * plane i3 of psinv for the fused v-cycle, followed by the axis 1 and
+ * 2 boundary exchange of that plane
+ * --------------------------------------------------------------------
+ */
+static void psinv_plane(void* pointer_r, void* pointer_u, int n1, int n2, int n3, double c[4], int i3){
+#ifdef __clang__
+	using custom_cast = double (*)[n2][n1];
+	custom_cast r = reinterpret_cast<custom_cast>(pointer_r);
+	using custom_cast2 = double (*)[n2][n1];
+	custom_cast2 u = reinterpret_cast<custom_cast2>(pointer_u);
+#else
+	double (*r)[n2][n1] = (double (*)[n2][n1])pointer_r;
+	double (*u)[n2][n1] = (double (*)[n2][n1])pointer_u;
+#endif
+
+	int i2, i1;
+	double r1[M], r2[M];
+
+	for(i2 = 1; i2 < n2-1; i2++){
+		for(i1 = 0; i1 < n1; i1++){
+			r1[i1] = r[i3][i2-1][i1] + r[i3][i2+1][i1]
+				+ r[i3-1][i2][i1] + r[i3+1][i2][i1];
+			r2[i1] = r[i3-1][i2-1][i1] + r[i3-1][i2+1][i1]
+				+ r[i3+1][i2-1][i1] + r[i3+1][i2+1][i1];
+		}
+		for(i1 = 1; i1 < n1-1; i1++){
+			u[i3][i2][i1] = u[i3][i2][i1]
+				+ c[0] * r[i3][i2][i1]
+				+ c[1] * ( r[i3][i2][i1-1] + r[i3][i2][i1+1]
+						+ r1[i1] )
+				+ c[2] * ( r2[i1] + r1[i1-1] + r1[i1+1] );
+		}
+		u[i3][i2][0] = u[i3][i2][n1-2];
+		u[i3][i2][n1-1] = u[i3][i2][1];
+	}
+	for(i1 = 0; i1 < n1; i1++){
+		u[i3][0][i1] = u[i3][n2-2][i1];
+		u[i3][n2-1][i1] = u[i3][1][i1];
+	}
+}
+
 /*
  * ---------------------------------------------------------------------
  * report on norm
@@ -1069,6 +1332,51 @@ static void resid(void* pointer_u, void* pointer_v, void* pointer_r, int n1, int
 	}
 }
 
+/*
+ * --------------------------------------------------------------------
+ * plane i3 of resid for the fused v-cycle, followed by the axis 1 and
+ * 2 boundary exchange of that plane
+ * --------------------------------------------------------------------
+ */
+static void resid_plane(void* pointer_u, void* pointer_v, void* pointer_r, int n1, int n2, int n3, double a[4], int i3){
+#ifdef __clang__
+	using custom_cast = double (*)[n2][n1];
+	custom_cast u = reinterpret_cast<custom_cast>(pointer_u);
+	using custom_cast2 = double (*)[n2][n1];
+	custom_cast2 v = reinterpret_cast<custom_cast2>(pointer_v);
+	using custom_cast3 = double (*)[n2][n1];
+	custom_cast3 r = reinterpret_cast<custom_cast3>(pointer_r);
+#else
+	double (*u)[n2][n1] = (double (*)[n2][n1])pointer_u;
+	double (*v)[n2][n1] = (double (*)[n2][n1])pointer_v;
+	double (*r)[n2][n1] = (double (*)[n2][n1])pointer_r;
+#endif
+
+	int i2, i1;
+	double u1[M], u2[M];
+
+	for(i2 = 1; i2 < n2-1; i2++){
+		for(i1 = 0; i1 < n1; i1++){
+			u1[i1] = u[i3][i2-1][i1] + u[i3][i2+1][i1]
+				+ u[i3-1][i2][i1] + u[i3+1][i2][i1];
+			u2[i1] = u[i3-1][i2-1][i1] + u[i3-1][i2+1][i1]
+				+ u[i3+1][i2-1][i1] + u[i3+1][i2+1][i1];
+		}
+		for(i1 = 1; i1 < n1-1; i1++){
+			r[i3][i2][i1] = v[i3][i2][i1]
+				- a[0] * u[i3][i2][i1]
+				- a[2] * ( u2[i1] + u1[i1-1] + u1[i1+1] )
+				- a[3] * ( u2[i1-1] + u2[i1+1] );
+		}
+		r[i3][i2][0] = r[i3][i2][n1-2];
+		r[i3][i2][n1-1] = r[i3][i2][1];
+	}
+	for(i1 = 0; i1 < n1; i1++){
+		r[i3][0][i1] = r[i3][n2-2][i1];
+		r[i3][n2-1][i1] = r[i3][1][i1];
+	}
+}
+
 /*
  * --------------------------------------------------------------------
  * rprj3 projects onto the next coarser grid,
@@ -44,6 +44,103 @@ Authors of the C++ code:
 #include <cstdlib>
 #include <cstdio>
 #include <cmath>
+#include <cstring>
+#include "rapl.h"
+
+#define MAX_JSON_DOMAINS (MAX_PACKAGES * NUM_RAPL_DOMAINS)
+
+extern double timer_read_energy(int);
+extern int timer_read_domain_energy(int, char[][64], double*, int);
+
+/* prints a JSON string, escaping quotes, backslashes and control characters */
+static void json_string(FILE* f, const char* s){
+	fputc('"', f);
+	for(; s != NULL && *s; s++){
+		if(*s == '"' || *s == '\\'){
+			fprintf(f, "\\%c", *s);
+		}else if((unsigned char)*s < 0x20){
+			fprintf(f, "\\u%04x", (unsigned char)*s);
+		}else{
+			fputc(*s, f);
+		}
+	}
+	fputc('"', f);
+}
+
+/*****************************************************************/
+/******          C  _  P  R  I  N  T  _  J  S  O  N         ******/
+/*****************************************************************/
+/*
+ * When NPB_JSON is set, c_print_results also appends the run as a single
+ * line of JSON to the file it names ("-" for stdout). Energy is that of
+ * timer t_energy, the one the benchmark time t was read from, so the total,
+ * each domain, the average power, Mop/s per watt and the energy-delay
+ * product (J*s) all cover the same timed interval.
+ */
+static void c_print_json(char* name,
+		char class_npb,
+		int n1,
+		int n2,
+		int n3,
+		int niter,
+		double t,
+		int t_energy,
+		double mops,
+		char* optype,
+		int passed_verification,
+		char* npbversion,
+		char* compiletime,
+		char* compilerversion,
+		char* totalthreads,
+		char* cc,
+		char* cflags,
+		char* clinkflags){
+	char* path = getenv("NPB_JSON");
+	if(path == NULL || path[0] == '\0'){return;}
+	FILE* f = (path[0] == '-' && path[1] == '\0') ? stdout : fopen(path, "a");
+	if(f == NULL){
+		fprintf(stderr, "Could not open %s\n", path);
+		return;
+	}
+
+	double energy = timer_read_energy(t_energy);
+	char domains[MAX_JSON_DOMAINS][64];
+	double joules[MAX_JSON_DOMAINS];
+	int num_domains = timer_read_domain_energy(t_energy, domains, joules, MAX_JSON_DOMAINS);
+	double power = (t > 0.0) ? energy / t : 0.0;
+
+	fprintf(f, "{\"benchmark\": ");
+	json_string(f, name);
+	fprintf(f, ", \"class\": \"%c\", \"size\": [%d, %d, %d], \"iterations\": %d",
+			class_npb, n1, n2, n3, niter);
+	fprintf(f, ", \"threads\": %d, \"time\": %.6f, \"mops\": %.4f, \"optype\": ",
+			atoi(totalthreads), t, mops);
+	json_string(f, optype + strspn(optype, " "));
+	fprintf(f, ", \"verification\": \"%s\"",
+			(passed_verification < 0) ? "not performed" :
+			(passed_verification ? "successful" : "unsuccessful"));
+	fprintf(f, ", \"version\": ");
+	json_string(f, npbversion);
+	fprintf(f, ", \"compile_date\": ");
+	json_string(f, compiletime);
+	fprintf(f, ", \"compiler\": ");
+	json_string(f, compilerversion);
+	fprintf(f, ", \"cc\": ");
+	json_string(f, cc);
+	fprintf(f, ", \"cflags\": ");
+	json_string(f, cflags);
+	fprintf(f, ", \"clinkflags\": ");
+	json_string(f, clinkflags);
+	fprintf(f, ", \"energy\": %.4f, \"domains\": {", energy);
+	for(int i = 0; i < num_domains; i++){
+		fprintf(f, "%s", (i > 0) ? ", " : "");
+		json_string(f, domains[i]);
+		fprintf(f, ": %.4f", joules[i]);
+	}
+	fprintf(f, "}, \"power\": %.4f, \"mops_per_watt\": %.4f, \"edp\": %.4f}\n",
+			power, (power > 0.0) ? mops / power : 0.0, energy * t);
+	if(f != stdout){fclose(f);}
+}
 
 /*****************************************************************/
 /******     C  _  P  R  I  N  T  _  R  E  S  U  L  T  S     ******/
@@ -55,6 +152,7 @@ void c_print_results(char* name,
 		int n3,
 		int niter,
 		double t,
+		int t_energy,
 		double mops,
 		char* optype,
 		int passed_verification,
@@ -150,4 +248,8 @@ void c_print_results(char* name,
 	printf("        dalvan.griebler; gabriell.araujo; junior.loff@edu.pucrs.br\n");
 	printf("----------------------------------------------------------------------\n");
 	printf("\n");
+
+	c_print_json(name, class_npb, n1, n2, n3, niter, t, t_energy, mops, optype,
+			passed_verification, npbversion, compiletime, compilerversion,
+			totalthreads, cc, cflags, clinkflags);
 }
@@ -42,7 +42,9 @@ Authors of the C++ code:
 */
 
 #include "wtime.hpp"
+#include "rapl.h"
 #include <cstdlib>
+#include <cstring>
 
 /*  prototype  */
 void wtime(double*);
@@ -57,18 +59,25 @@ double elapsed_time(void){
 }
 
 double start[64], elapsed[64];
+/* energy of each timer, from the RAPL counters read at start and stop */
+rapl_counters start_energy[64];
+double elapsed_energy[64];
+rapl_joules elapsed_domain_energy[64];
 
 /*****************************************************************/
 /******            T  I  M  E  R  _  C  L  E  A  R          ******/
 /*****************************************************************/
 void timer_clear(int n){
 	elapsed[n] = 0.0;
+	elapsed_energy[n] = 0.0;
+	memset(elapsed_domain_energy[n], 0, sizeof(rapl_joules));
 }
 
 /*****************************************************************/
 /******            T  I  M  E  R  _  S  T  A  R  T          ******/
 /*****************************************************************/
 void timer_start(int n){
+	read_rapl_snapshot(start_energy[n]);
 	start[n] = elapsed_time();
 }
 
@@ -81,6 +90,9 @@ void timer_stop(int n){
 	t = now - start[n];
 	elapsed[n] += t;
 
+	rapl_counters stop_energy;
+	read_rapl_snapshot(stop_energy);
+	elapsed_energy[n] += rapl_snapshot_energy(start_energy[n], stop_energy, elapsed_domain_energy[n]);
 }
 
 /*****************************************************************/
@@ -89,3 +101,25 @@ void timer_stop(int n){
 double timer_read(int n){
 	return(elapsed[n]);
 }
+
+/*****************************************************************/
+/******          T I M E R _ R E A D _ E N E R G Y          ******/
+/*****************************************************************/
+double timer_read_energy(int n){
+	return(elapsed_energy[n]);
+}
+
+/*****************************************************************/
+/******           T I M E R _ R E A D _ P O W E R           ******/
+/*****************************************************************/
+double timer_read_power(int n){
+	if(elapsed[n] <= 0.0){return(0.0);}
+	return(elapsed_energy[n] / elapsed[n]);
+}
+
+/*****************************************************************/
+/******   T I M E R _ R E A D _ D O M A I N _ E N E R G Y   ******/
+/*****************************************************************/
+int timer_read_domain_energy(int n, char names[][64], double* joules, int max_domains){
+	return(rapl_snapshot_domains(elapsed_domain_energy[n], names, joules, max_domains));
+}
@@ -92,6 +92,9 @@ extern void timer_clear(int);
 extern void timer_start(int);
 extern void timer_stop(int);
 extern double timer_read(int);
+extern double timer_read_energy(int);
+extern double timer_read_power(int);
+extern int timer_read_domain_energy(int, char[][64], double*, int);
 
 extern void c_print_results(char* name,
 		char class_npb,
@@ -100,6 +103,7 @@ extern void c_print_results(char* name,
 		int n3,
 		int niter,
 		double t,
+		int t_energy,
 		double mops,
 		char* optype,
 		int passed_verification,
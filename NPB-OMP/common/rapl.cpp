@@ -216,35 +216,42 @@ double end_rapl_sysfs(){
         return end_rapl_parcial_reading();
 }
 
+/* Energy of one domain from the start reading through the alarm readings to the end one */
+static double domain_energy(int j, int i){
+        int k;
+        double total=0;
+        double before = (double)kernelBefore[j][i];
+        for(k=0;k<leituras;k++) {
+                double current = (double) parcial[k][j][i];
+
+                if(before <= current)
+                {
+                        total += ((current-before)/1000000.0);
+                }else{
+                        total += (((max_energy_range_uj-before)+ current)/1000000.0);
+                }
+
+                before = current;
+        }
+
+        double after  = (double)kernelAfter[j][i];
+        if(before <= after){
+                total += ((after-before)/1000000.0);
+        }else{
+                total += (((max_energy_range_uj-before)+ after)/1000000.0);
+        }
+        return total;
+}
+
 double end_rapl_parcial_reading(){
-        int i, j, k;
+        int i, j;
     double total=0;
 
         for(j=0;j<total_packages;j++) {
         for(i=0;i<NUM_RAPL_DOMAINS;i++) {
                 if(valid[j][i]){
                 if(strcmp(event_names[j][i],"core")!=0 && strcmp(event_names[j][i],"uncore")!=0){
-                                        double before = (double)kernelBefore[j][i];
-                        for(k=0;k<leituras;k++) {
-                                                double current = (double) parcial[k][j][i];
-
-                                                if(before < current)
-                        {
-                                                        total += ((current-before)/1000000.0);
-                                                }else{
-                                                        total += (((max_energy_range_uj-before)+ current)/1000000.0);
-                                                }
-
-                                                before = current;
-                                        }
-
-                                        double after  = (double)kernelAfter[j][i];
-                                        if(before < after){
-                                                total += ((after-before)/1000000.0);
-                                        }else{
-                                                total += (((max_energy_range_uj-before)+ after)/1000000.0);
-                                        }
-
+                                        total += domain_energy(j, i);
                                 }
                 }
         }
@@ -254,8 +261,6 @@ double end_rapl_parcial_reading(){
     return total;
 }
 
-
-
 void ALARMhandler(int sig) {
     if(read_count_energy){
                 int i, j;
@@ -286,4 +291,93 @@ void detect_max_energy_range_uj(){
         max_energy_range_uj = (double) max;
         //printf("%.2f\n", max_energy_range_uj);
         fclose(file);
-}
\ No newline at end of file
+}
+/*
+ * Snapshots of the counters cheap enough to take at every timer_start and
+ * timer_stop: the energy_uj file of each counted domain (the same ones
+ * end_rapl_parcial_reading sums, so no core or uncore) is opened once and
+ * re-read with pread. Nothing is counted before rapl_init.
+ */
+static int snapshot_fd[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+static int snapshot_open = 0;
+
+static void open_rapl_snapshot(){
+        int i, j;
+        for(j=0;j<MAX_PACKAGES;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        snapshot_fd[j][i] = -1;
+                        if(j<total_packages && valid[j][i] &&
+                           strcmp(event_names[j][i],"core")!=0 && strcmp(event_names[j][i],"uncore")!=0){
+                                snapshot_fd[j][i] = open(filenames[j][i], O_RDONLY);
+                        }
+                }
+        }
+        snapshot_open = 1;
+}
+
+void read_rapl_snapshot(rapl_counters counters){
+        int i, j;
+        char buffer[32];
+        if(!snapshot_open) {
+                if(total_packages==0) {
+                        memset(counters, 0, sizeof(rapl_counters));
+                        return;
+                }
+                open_rapl_snapshot();
+        }
+        for(j=0;j<MAX_PACKAGES;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        counters[j][i] = 0;
+                        if(snapshot_fd[j][i]<0) continue;
+                        ssize_t n = pread(snapshot_fd[j][i], buffer, sizeof(buffer)-1, 0);
+                        if(n>0) {
+                                buffer[n] = '\0';
+                                counters[j][i] = atoll(buffer);
+                        }
+                }
+        }
+}
+
+/* Joules between two snapshots, in the way end_rapl_parcial_reading handles
+   wrap-around; when domains is not NULL each domain's share is added to it */
+double rapl_snapshot_energy(rapl_counters before, rapl_counters after, rapl_joules domains){
+        int i, j;
+        double total=0;
+        if(!snapshot_open) return 0.0;
+        for(j=0;j<total_packages;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+                        if(snapshot_fd[j][i]<0) continue;
+                        double b = (double)before[j][i];
+                        double a = (double)after[j][i];
+                        double joules;
+                        if(b <= a){
+                                joules = ((a-b)/1000000.0);
+                        }else{
+                                joules = (((max_energy_range_uj-b)+ a)/1000000.0);
+                        }
+                        total += joules;
+                        if(domains!=NULL) domains[j][i] += joules;
+                }
+        }
+        return total;
+}
+
+/* Flattens the per-domain joules of rapl_snapshot_energy into names like
+   "package-0" and "package-0:dram". Each part of a name is cut to 31
+   characters so the pair always fits in 64. */
+int rapl_snapshot_domains(rapl_joules domains, char names[][64], double *joules, int max_domains){
+        int i, j, count=0;
+        if(!snapshot_open) return 0;
+        for(j=0;j<total_packages;j++) {
+                for(i=0;i<NUM_RAPL_DOMAINS && count<max_domains;i++) {
+                        if(snapshot_fd[j][i]<0) continue;
+                        if(i==0)
+                                snprintf(names[count],64,"%.31s",event_names[j][0]);
+                        else
+                                snprintf(names[count],64,"%.31s:%.31s",event_names[j][0],event_names[j][i]);
+                        joules[count] = domains[j][i];
+                        count++;
+                }
+        }
+        return count;
+}
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <fcntl.h>
 
 using namespace std;
 
@@ -38,6 +39,14 @@ void start_rapl_sysfs(void);
 void start_rapl_sysfs_global(void);
 double end_rapl_sysfs(void);
 
+/*-----------------------------*/
+/* cheap counter snapshots (timers) */
+typedef long long rapl_counters[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+typedef double rapl_joules[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+void read_rapl_snapshot(rapl_counters counters);
+double rapl_snapshot_energy(rapl_counters before, rapl_counters after, rapl_joules domains);
+int rapl_snapshot_domains(rapl_joules domains, char names[][64], double *joules, int max_domains);
+
 /*-----------------------------*/
 void ALARMhandler(int);
 double end_rapl_parcial_reading();
@@ -0,0 +1,126 @@
+#ifndef HYBRID_BARRIER_H
+#define HYBRID_BARRIER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+ * Barrier that spins with pause for a budget and then parks the thread on a
+ * futex, so that cores waiting for the slowest socket stop drawing full
+ * power. The budget is either fixed (ns) or adaptive: it follows an
+ * average of the recent waits, spinning up to twice that while waits stay
+ * shorter than kSpinLimitNs (about what a park and wake-up costs) and
+ * parking almost at once when they are longer.
+ *
+ * Subworker_Partitioner uses one per node for its subworkers and one for
+ * the subMasters of all nodes, the same hierarchy as its Custom_barrier
+ * pair.
+ */
+struct BarrierWaitStats {
+    double waitTime;
+    long waits;
+    long parks;
+    char pad[64];
+};
+
+static inline long barrierNowNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+struct HybridBarrier {
+    static const long kSpinLimitNs = 50000;
+    static const long kMinSpinNs = 1000;
+
+    int n;
+    volatile int arrived;
+    volatile int generation;
+    volatile int sleepers;
+    volatile long spinNs;
+    bool adaptive;
+    volatile double expectedNs;
+
+    void init(int _n, long _spinNs, bool _adaptive) {
+	n = _n;
+	arrived = 0;
+	generation = 0;
+	sleepers = 0;
+	spinNs = _adaptive ? kSpinLimitNs : _spinNs;
+	adaptive = _adaptive;
+	expectedNs = 0.0;
+    }
+
+    void wait(BarrierWaitStats *stats = NULL) {
+	int gen = generation;
+	long begin = barrierNowNs();
+	if (__sync_add_and_fetch(&arrived, 1) == n) {
+	    arrived = 0;
+	    __sync_fetch_and_add(&generation, 1);
+	    if (sleepers > 0)
+		syscall(SYS_futex, &generation, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	    if (stats) stats->waits++;
+	    return;
+	}
+	bool parked = false;
+	long budget = spinNs;
+	while (generation == gen) {
+	    if (barrierNowNs() - begin < budget) {
+		for (int i = 0; i < 64 && generation == gen; i++) __builtin_ia32_pause();
+		continue;
+	    }
+	    __sync_fetch_and_add(&sleepers, 1);
+	    while (generation == gen)
+		syscall(SYS_futex, &generation, FUTEX_WAIT_PRIVATE, gen, NULL, NULL, 0);
+	    __sync_fetch_and_sub(&sleepers, 1);
+	    parked = true;
+	}
+	long waited = barrierNowNs() - begin;
+	if (adaptive) {
+	    double expected = 0.875 * expectedNs + 0.125 * waited;
+	    expectedNs = expected;
+	    spinNs = (expected < kSpinLimitNs) ? (long)(2 * expected) : kMinSpinNs;
+	    if (spinNs < kMinSpinNs) spinNs = kMinSpinNs;
+	    if (spinNs > kSpinLimitNs) spinNs = kSpinLimitNs;
+	}
+	if (stats) {
+	    stats->waitTime += waited / 1e9;
+	    stats->waits++;
+	    stats->parks += parked;
+	}
+    }
+};
+
+// Parses -spin: a budget in ns, or "adaptive"
+static inline void parseSpinOption(const char *opt, long *spinNs, bool *adaptive) {
+    *adaptive = (opt[0] == 'a');
+    *spinNs = *adaptive ? 0 : atol(opt);
+}
+
+// Per-thread wait time and an estimate of its wait energy: the run's energy
+// split evenly over thread-seconds, charged for the seconds spent waiting
+static inline void reportBarrierWaits(BarrierWaitStats *stats, int numOfNodes, int coresPerNode,
+				      double seconds, double energy) {
+    int threads = numOfNodes * coresPerNode;
+    double totalWait = 0.0;
+    for (int i = 0; i < threads; i++) {
+	BarrierWaitStats &s = stats[i];
+	double joules = (seconds > 0) ? energy * s.waitTime / (threads * seconds) : 0.0;
+	printf("thread %d.%d wait : %lf s (%.1f%%) %ld waits %ld parked, ~%.4f J\n",
+	       i / coresPerNode, i % coresPerNode, s.waitTime,
+	       seconds > 0 ? 100.0 * s.waitTime / seconds : 0.0, s.waits, s.parks, joules);
+	totalWait += s.waitTime;
+	s.waitTime = 0.0;
+	s.waits = s.parks = 0;
+    }
+    if (seconds > 0)
+	printf("Barrier wait energy : ~%.4f (%.1f%% of thread time)\n",
+	       energy * totalWait / (threads * seconds), 100.0 * totalWait / (threads * seconds));
+}
+
+#endif
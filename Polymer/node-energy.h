@@ -0,0 +1,137 @@
+#ifndef NODE_ENERGY_H
+#define NODE_ENERGY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <numa.h>
+
+#include "rapl.h"
+
+/*
+ * Splits the time and RAPL energy of every iteration by NUMA node: the part
+ * a node spends working until it reaches a global barrier (time-to-barrier)
+ * and the part it spends there waiting for the slowest node
+ * (idle-at-barrier). A node is charged the package and DRAM domains of the
+ * socket its CPUs belong to. Only the subMaster of a node writes its slot,
+ * through Subworker_Partitioner::globalWait, so no locking is needed; the
+ * totals are read once the workers are parked.
+ */
+struct NodeEnergyMeter {
+    struct Slot {
+	double mark;
+	struct rapl_snapshot snap;
+	double busyTime, idleTime, busyEnergy, idleEnergy;
+	double totalBusyTime, totalIdleTime, totalBusyEnergy, totalIdleEnergy;
+	char pad[64];
+    };
+
+    bool enabled;
+    bool verbose; //print every iteration, not just the totals
+    int numOfNodes;
+    int *package;
+    Slot *slots;
+
+    NodeEnergyMeter():enabled(false), verbose(true), numOfNodes(0), package(NULL), slots(NULL) {}
+
+    static double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return ((double)t.tv_sec) + ((double)t.tv_usec) / 1000000.0;
+    }
+
+    // Socket of the first CPU of a node, -1 if it has no RAPL package
+    static int packageOfNode(int node) {
+	for (int cpu = 0; cpu < numa_num_configured_cpus(); cpu++) {
+	    if (numa_node_of_cpu(cpu) != node) continue;
+	    char filename[128];
+	    sprintf(filename, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+	    FILE *fff = fopen(filename, "r");
+	    int p = -1;
+	    if (fff != NULL) {
+		if (fscanf(fff, "%d", &p) != 1) p = -1;
+		fclose(fff);
+	    }
+	    return (p >= 0 && p < rapl_packages()) ? p : -1;
+	}
+	return -1;
+    }
+
+    void init(int nodes) {
+	if (slots != NULL) return;
+	numOfNodes = nodes;
+	package = (int *)malloc(sizeof(int) * nodes);
+	slots = (Slot *)calloc(nodes, sizeof(Slot));
+	for (int i = 0; i < nodes; i++) {
+	    package[i] = packageOfNode(i);
+	    int sharing = 0;
+	    for (int j = 0; j <= i; j++) sharing += (package[j] == package[i]);
+	    if (package[i] < 0)
+		printf("node %d: no RAPL package, energy not attributed\n", i);
+	    else if (sharing > 1)
+		printf("node %d: package %d is shared with another node\n", i, package[i]);
+	}
+    }
+
+    // Joules of the node's package since its last reading
+    double readEnergy(int node) {
+	Slot &s = slots[node];
+	if (package[node] < 0) return 0.0;
+	struct rapl_snapshot curr;
+	read_rapl_package_snapshot(&curr, package[node]);
+	double joules = rapl_snapshot_package_energy(&s.snap, &curr, package[node], 0) +
+	    rapl_snapshot_package_energy(&s.snap, &curr, package[node], 1);
+	s.snap = curr;
+	return joules;
+    }
+
+    void beginIteration(int node) {
+	Slot &s = slots[node];
+	s.busyTime = s.idleTime = s.busyEnergy = s.idleEnergy = 0.0;
+	readEnergy(node);
+	s.mark = now();
+    }
+
+    // The node's subworkers all reached a global barrier
+    void arrive(int node) {
+	Slot &s = slots[node];
+	double t = now();
+	s.busyTime += t - s.mark;
+	s.busyEnergy += readEnergy(node);
+	s.mark = t;
+    }
+
+    // Every node reached it
+    void leave(int node) {
+	Slot &s = slots[node];
+	double t = now();
+	s.idleTime += t - s.mark;
+	s.idleEnergy += readEnergy(node);
+	s.mark = t;
+    }
+
+    void endIteration(int node, int iter) {
+	Slot &s = slots[node];
+	if (verbose)
+	    printf("iter %d node %d: busy %lf s %.4f J, idle at barrier %lf s %.4f J\n",
+		   iter, node, s.busyTime, s.busyEnergy, s.idleTime, s.idleEnergy);
+	s.totalBusyTime += s.busyTime;
+	s.totalIdleTime += s.idleTime;
+	s.totalBusyEnergy += s.busyEnergy;
+	s.totalIdleEnergy += s.idleEnergy;
+    }
+
+    // Prints and clears the totals since the last report
+    void report() {
+	for (int i = 0; i < numOfNodes; i++) {
+	    Slot &s = slots[i];
+	    double energy = s.totalBusyEnergy + s.totalIdleEnergy;
+	    printf("node %d energy : %.4f (busy %lf s %.4f J, idle at barrier %lf s %.4f J, %.1f%% idle)\n",
+		   i, energy, s.totalBusyTime, s.totalBusyEnergy, s.totalIdleTime, s.totalIdleEnergy,
+		   energy > 0 ? 100.0 * s.totalIdleEnergy / energy : 0.0);
+	    s.totalBusyTime = s.totalIdleTime = s.totalBusyEnergy = s.totalIdleEnergy = 0.0;
+	}
+    }
+};
+
+#endif
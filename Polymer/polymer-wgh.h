@@ -29,9 +29,12 @@
 #include <cstring>
 #include <string>
 #include <algorithm>
+#include <map>
 #include <sys/mman.h>
 
 #include "custom-barrier.h"
+#include "node-energy.h"
+#include "hybrid-barrier.h"
 #include "parallel.h"
 #include "gettime.h"
 #include "utils.h"
@@ -39,6 +42,7 @@
 #include "IO.h"
 
 #include <numa.h>
+#include <numaif.h>
 #include <pthread.h>
 
 using namespace std;
@@ -82,23 +86,34 @@ struct Subworker_Partitioner {
     pthread_barrier_t *local_barr;
     Custom_barrier local_custom;
     Custom_barrier subMaster_custom;
+    NodeEnergyMeter *meter; //splits node time/energy at global barriers if set
+    HybridBarrier *local_hybrid; //replace the Custom_barrier pair if set
+    HybridBarrier *subMaster_hybrid;
+    BarrierWaitStats *wait_stats;
 
-    Subworker_Partitioner(int nSub):numOfSub(nSub){}
+    Subworker_Partitioner(int nSub):numOfSub(nSub), meter(NULL), local_hybrid(NULL), subMaster_hybrid(NULL), wait_stats(NULL){}
 
     inline bool isMaster() {return (tid + subTid == 0);}
     inline bool isSubMaster() {return (subTid == 0);}
     inline intT getStartPos(intT m) {return subTid * (m / numOfSub);}
     inline intT getEndPos(intT m) {return (subTid == numOfSub - 1) ? m : ((subTid + 1) * (m / numOfSub));}
 
+    inline void nodeWait() {
+	if (local_hybrid) local_hybrid->wait(wait_stats);
+	else local_custom.wait();
+    }
     inline void localWait() {
-	local_custom.wait();
+	nodeWait();
     }
     inline void globalWait() {
-	local_custom.wait();
+	nodeWait();
 	if (isSubMaster()) {
-	    subMaster_custom.wait();
+	    if (meter) meter->arrive(tid);
+	    if (subMaster_hybrid) subMaster_hybrid->wait(wait_stats);
+	    else subMaster_custom.wait();
+	    if (meter) meter->leave(tid);
 	}
-	local_custom.wait();
+	nodeWait();
     }
 };
 
@@ -489,28 +504,136 @@ wghGraph<vertex> graphFilter2Direction(wghGraph<vertex> &GA, intT rangeLow, intT
     return wghGraph<vertex>(newVertexSet, GA.n, GA.m);
 }
 
-void *mapDataArray(int numOfShards, intT *sizeArr, int sizeOfOneEle) {
-    intT numOfPages = 0;
-    for (int i = 0; i < numOfShards; i++) {
-        numOfPages += sizeArr[i] / (double)(PAGESIZE / sizeOfOneEle);
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// Page size backing the data arrays of mapDataArray: PAGESIZE, or 2 MiB or
+// 1 GiB huge pages (see setDataPageSize). Huge pages must be reserved
+// beforehand (vm.nr_hugepages or hugepagesz= at boot); if the mapping
+// fails the array falls back to base pages.
+long dataPageSize = PAGESIZE;
+
+// Length of every mapping made by mapDataArray, for freeDataArray
+std::map<void *, long> dataArrayLength;
+
+// Parses the value of -hugepage: 2M, 1G, or anything else for base pages
+void setDataPageSize(const char *opt) {
+    dataPageSize = PAGESIZE;
+    if (opt == NULL) return;
+    if (strcmp(opt, "2M") == 0) dataPageSize = 1L << 21;
+    else if (strcmp(opt, "1G") == 0) dataPageSize = 1L << 30;
+    else printf("unknown page size %s, using base pages\n", opt);
+}
+
+// Value following name on the command line, or NULL
+char *findOption(int argc, char *argv[], const char *name) {
+    for (int i = 1; i + 1 < argc; i++) {
+	if (strcmp(argv[i], name) == 0) return argv[i+1];
     }
-    numOfPages++;
+    return NULL;
+}
+
+// Whether the flag name is on the command line
+bool findFlag(int argc, char *argv[], const char *name) {
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void *mapPages(long length, long pageSize) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (pageSize != PAGESIZE) {
+	int shift = (pageSize == (1L << 30)) ? 30 : 21;
+	flags |= MAP_HUGETLB | (shift << MAP_HUGE_SHIFT);
+    }
+    return mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
 
-    void *toBeReturned = mmap(NULL, numOfPages * PAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (toBeReturned == NULL) {
-	cout << "OOps" << endl;
+// Reports, per shard, how many of the pages bound to its node actually sit
+// there according to move_pages, how many are on another node and how many
+// are not faulted in yet.
+void reportDataPlacement(void *arr, int numOfShards, intT *sizeArr, int sizeOfOneEle, long pageSize) {
+    long startByte = 0;
+    for (int i = 0; i < numOfShards; i++) {
+	long endByte = startByte + (long)sizeArr[i] * sizeOfOneEle;
+	long first = (startByte + pageSize - 1) / pageSize;
+	long last = (endByte + pageSize - 1) / pageSize;
+	if (i == 0) first = 0;
+	long count = last - first;
+	long local = 0, remote = 0, missing = 0;
+	if (count > 0) {
+	    void **pages = (void **)malloc(sizeof(void *) * count);
+	    int *status = (int *)malloc(sizeof(int) * count);
+	    for (long p = 0; p < count; p++)
+		pages[p] = (char *)arr + (first + p) * pageSize;
+	    if (move_pages(0, count, pages, NULL, status, 0) != 0) {
+		perror("move_pages");
+		missing = count;
+	    } else {
+		for (long p = 0; p < count; p++) {
+		    if (status[p] == i) local++;
+		    else if (status[p] >= 0) remote++;
+		    else missing++;
+		}
+	    }
+	    free(pages);
+	    free(status);
+	}
+	printf("placement node %d: %ld pages of %ld KiB, %ld local, %ld remote, %ld missing\n",
+	       i, count, pageSize / 1024, local, remote, missing);
+	startByte = endByte;
     }
+}
 
-    intT offset = 0;
+// Maps one array split into numOfShards consecutive shards of sizeArr[i]
+// elements, shard i bound to node i. A page belongs to the shard holding
+// its first byte, so only pages straddling two shards are split unevenly.
+// The pages are faulted in here, under the binding, so setup pays for them
+// rather than the first traversal.
+void *mapDataArray(int numOfShards, intT *sizeArr, int sizeOfOneEle) {
+    long bytes = 0;
     for (int i = 0; i < numOfShards; i++) {
-	void *startPos = (void *)((char *)toBeReturned + offset * sizeOfOneEle);
-	//printf("start binding %d : %" PRIintT "\n", i, offset);
-	numa_tonode_memory(startPos, sizeArr[i], i);
-	offset = offset + sizeArr[i];
+	bytes += (long)sizeArr[i] * sizeOfOneEle;
     }
+    long pageSize = dataPageSize;
+    long length = (bytes / pageSize + 1) * pageSize;
+    void *toBeReturned = mapPages(length, pageSize);
+    if (toBeReturned == MAP_FAILED && pageSize != PAGESIZE) {
+	printf("no %ld KiB huge pages available, using base pages\n", pageSize / 1024);
+	pageSize = PAGESIZE;
+	length = (bytes / pageSize + 1) * pageSize;
+	toBeReturned = mapPages(length, pageSize);
+    }
+    if (toBeReturned == MAP_FAILED) {
+	perror("mapDataArray");
+	exit(1);
+    }
+
+    long startByte = 0;
+    for (int i = 0; i < numOfShards; i++) {
+	long endByte = startByte + (long)sizeArr[i] * sizeOfOneEle;
+	long first = (i == 0) ? 0 : (startByte + pageSize - 1) / pageSize * pageSize;
+	long last = (i == numOfShards - 1) ? length : (endByte + pageSize - 1) / pageSize * pageSize;
+	//printf("start binding %d : %ld\n", i, first);
+	if (last > first)
+	    numa_tonode_memory((char *)toBeReturned + first, last - first, i);
+	startByte = endByte;
+    }
+    for (long p = 0; p < length; p += pageSize) {
+	((char *)toBeReturned)[p] = 0;
+    }
+    reportDataPlacement(toBeReturned, numOfShards, sizeArr, sizeOfOneEle, pageSize);
+    dataArrayLength[toBeReturned] = length;
     return toBeReturned;
 }
 
+void freeDataArray(void *arr) {
+    munmap(arr, dataArrayLength[arr]);
+    dataArrayLength.erase(arr);
+}
+
 struct AsyncChunk {
     intT accessCounter;
     intT m;
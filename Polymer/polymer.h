@@ -26,12 +26,16 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <stdint.h>
 #include <cstring>
 #include <string>
 #include <algorithm>
+#include <map>
 #include <sys/mman.h>
 
 #include "custom-barrier.h"
+#include "node-energy.h"
+#include "hybrid-barrier.h"
 #include "parallel.h"
 #include "gettime.h"
 #include "utils.h"
@@ -39,6 +43,7 @@
 #include "IO-numa.h"
 
 #include <numa.h>
+#include <numaif.h>
 #include <pthread.h>
 
 using namespace std;
@@ -83,23 +88,34 @@ struct Subworker_Partitioner {
     pthread_barrier_t *leader_barr;
     Custom_barrier local_custom;
     Custom_barrier subMaster_custom;
+    NodeEnergyMeter *meter; //splits node time/energy at global barriers if set
+    HybridBarrier *local_hybrid; //replace the Custom_barrier pair if set
+    HybridBarrier *subMaster_hybrid;
+    BarrierWaitStats *wait_stats;
 
-    Subworker_Partitioner(int nSub):numOfSub(nSub){}
+    Subworker_Partitioner(int nSub):numOfSub(nSub), meter(NULL), local_hybrid(NULL), subMaster_hybrid(NULL), wait_stats(NULL){}
 
     inline bool isMaster() {return (tid + subTid == 0);}
     inline bool isSubMaster() {return (subTid == 0);}
     inline intT getStartPos(intT m) {return subTid * (m / numOfSub);}
     inline intT getEndPos(intT m) {return (subTid == numOfSub - 1) ? m : ((subTid + 1) * (m / numOfSub));}
 
+    inline void nodeWait() {
+	if (local_hybrid) local_hybrid->wait(wait_stats);
+	else local_custom.wait();
+    }
     inline void localWait() {
-	local_custom.wait();
+	nodeWait();
     }
     inline void globalWait() {
-	local_custom.wait();
+	nodeWait();
 	if (isSubMaster()) {
-	    subMaster_custom.wait();
+	    if (meter) meter->arrive(tid);
+	    if (subMaster_hybrid) subMaster_hybrid->wait(wait_stats);
+	    else subMaster_custom.wait();
+	    if (meter) meter->leave(tid);
 	}
-	local_custom.wait();
+	nodeWait();
     }
 };
 
@@ -128,8 +144,11 @@ struct Default_Hash_F {
     }
 };
 
+// Splits the vertices into numOfShards page-aligned ranges of about equal
+// degree, or, given shares, with shard i holding about shares[i] of the
+// total degree (see ShardRebalancer)
 template <class vertex>
-void partitionByDegree(graph<vertex> GA, int numOfShards, intT *sizeArr, intT sizeOfOneEle, bool useOutDegree=false) {
+void partitionByDegree(graph<vertex> GA, int numOfShards, intT *sizeArr, intT sizeOfOneEle, bool useOutDegree=false, const double *shares=NULL) {
     const intT n = GA.n;
     intT *degrees = newA(intT, n);
 
@@ -154,6 +173,10 @@ void partitionByDegree(graph<vertex> GA, int numOfShards, intT *sizeArr, intT si
 
     intT averageDegree = totalDegree / numOfShards;
     printf("average is %" PRIintT "\n", averageDegree);
+    intT target[numOfShards];
+    for (int i = 0; i < numOfShards; i++) {
+	target[i] = shares ? (intT)(totalDegree * shares[i]) : averageDegree;
+    }
     intT counter = 0;
     intT tmpSizeCounter = 0;
     for (intT i = 0; i < n; i+=PAGESIZE/sizeOfOneEle) {
@@ -170,9 +193,9 @@ void partitionByDegree(graph<vertex> GA, int numOfShards, intT *sizeArr, intT si
 	}
 	accum[counter] += localAccum;
 	sizeArr[counter] += localSize;
-	if (accum[counter] >= averageDegree && counter < numOfShards - 1) {
-	    intT oldDiff = averageDegree - (accum[counter] - localAccum);
-	    intT newDiff = accum[counter] - averageDegree;
+	if (accum[counter] >= target[counter] && counter < numOfShards - 1) {
+	    intT oldDiff = target[counter] - (accum[counter] - localAccum);
+	    intT newDiff = accum[counter] - target[counter];
 	    if (oldDiff < newDiff) {
 		accum[counter] -= localAccum;
 		sizeArr[counter] -= localSize;
@@ -191,6 +214,68 @@ void partitionByDegree(graph<vertex> GA, int numOfShards, intT *sizeArr, intT si
     free(degrees);
 }
 
+// Degree held by each shard of sizeArr, as partitionByDegree counts it
+template <class vertex>
+void shardDegrees(graph<vertex> &GA, int numOfShards, intT *sizeArr, long long *degree, bool useOutDegree=false) {
+    intT prev = 0;
+    for (int i = 0; i < numOfShards; i++) {
+	degree[i] = 0;
+	for (intT v = prev; v < prev + sizeArr[i]; v++) {
+	    degree[i] += useOutDegree ? GA.V[v].getOutDegree() : GA.V[v].getInDegree();
+	}
+	prev += sizeArr[i];
+    }
+}
+
+/*
+ * Energy-feedback repartitioning. plan() takes the degree each shard held
+ * and the busy and idle-at-barrier time and energy its node measured over
+ * one or more rounds (NodeEnergyMeter), and computes the degree shares that
+ * would give every node the same busy time, i.e. each node's share is
+ * proportional to the degree it processes per second. It then predicts
+ * what a round gains with those shares: the time by which the slowest node
+ * finishes earlier, and the energy from moving busy joules between nodes
+ * at their measured joules per degree and cutting each node's wait to the
+ * shortest one measured, at its measured idle power. The caller moves the
+ * data only if gain times the remaining rounds beats the migration cost.
+ */
+struct ShardRebalancer {
+    int numOfShards;
+    double *shares;
+    double timeGain;
+    double energyGain;
+
+    ShardRebalancer(int _numOfShards):numOfShards(_numOfShards), timeGain(0.0), energyGain(0.0) {
+	shares = (double *)malloc(sizeof(double) * numOfShards);
+    }
+    ~ShardRebalancer() { free(shares); }
+
+    // Returns false, with no gain, if some node has no measurement
+    bool plan(const long long *degree, const double *busyTime, const double *busyEnergy,
+	      const double *idleTime, const double *idleEnergy) {
+	timeGain = energyGain = 0.0;
+	double rate = 0.0, totalDegree = 0.0, minIdle = idleTime[0];
+	for (int i = 0; i < numOfShards; i++) {
+	    if (degree[i] <= 0 || busyTime[i] <= 0.0) return false;
+	    rate += degree[i] / busyTime[i];
+	    totalDegree += degree[i];
+	    if (idleTime[i] < minIdle) minIdle = idleTime[i];
+	}
+	double balancedTime = totalDegree / rate;
+	double slowest = 0.0, energyNow = 0.0, energyThen = 0.0;
+	for (int i = 0; i < numOfShards; i++) {
+	    shares[i] = (degree[i] / busyTime[i]) / rate;
+	    if (busyTime[i] > slowest) slowest = busyTime[i];
+	    double idlePower = (idleTime[i] > 0.0) ? idleEnergy[i] / idleTime[i] : busyEnergy[i] / busyTime[i];
+	    energyNow += busyEnergy[i] + idleEnergy[i];
+	    energyThen += shares[i] * totalDegree * (busyEnergy[i] / degree[i]) + minIdle * idlePower;
+	}
+	timeGain = slowest - balancedTime;
+	energyGain = energyNow - energyThen;
+	return true;
+    }
+};
+
 template <class vertex>
 void subPartitionByDegree(graph<vertex> GA, int numOfShards, intT *sizeArr, int sizeOfOneEle, bool useOutDegree=false, bool useFakeDegree=false) {
     const intT n = GA.n;
@@ -496,34 +581,192 @@ graph<vertex> graphFilter2Direction(graph<vertex> &GA, intT rangeLow, intT range
     return graph<vertex>(newVertexSet, GA.n, GA.m);
 }
 
-void *mapDataArray(int numOfShards, intT *sizeArr, int sizeOfOneEle) {
-    intT numOfPages = 0;
-    for (int i = 0; i < numOfShards; i++) {
-        numOfPages += sizeArr[i] / (double)(PAGESIZE / sizeOfOneEle);
+// Frees a graph built by graphFilter2Direction on the calling node
+template <class vertex>
+void delFilteredGraph(graph<vertex> &G) {
+    intT totalSize = 0;
+    intT totalInSize = 0;
+    for (intT i = 0; i < G.n; i++) {
+	totalSize += G.V[i].getFakeDegree();
+	totalInSize += G.V[i].getFakeInDegree();
+    }
+    if (totalSize > 0)
+	numa_free(G.V[0].getOutNeighborPtr(), sizeof(intE) * totalSize);
+    if (totalInSize > 0)
+	numa_free(G.V[0].getInNeighborPtr(), sizeof(intE) * totalInSize);
+    numa_free(G.V, sizeof(vertex) * G.n);
+}
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// Page size backing the data arrays of mapDataArray: PAGESIZE, or 2 MiB or
+// 1 GiB huge pages (see setDataPageSize). Huge pages must be reserved
+// beforehand (vm.nr_hugepages or hugepagesz= at boot); if the mapping
+// fails the array falls back to base pages.
+long dataPageSize = PAGESIZE;
+
+// Length of every mapping made by mapDataArray, for freeDataArray
+std::map<void *, long> dataArrayLength;
+
+// Parses the value of -hugepage: 2M, 1G, or anything else for base pages
+void setDataPageSize(const char *opt) {
+    dataPageSize = PAGESIZE;
+    if (opt == NULL) return;
+    if (strcmp(opt, "2M") == 0) dataPageSize = 1L << 21;
+    else if (strcmp(opt, "1G") == 0) dataPageSize = 1L << 30;
+    else printf("unknown page size %s, using base pages\n", opt);
+}
+
+// Value following name on the command line, or NULL
+char *findOption(int argc, char *argv[], const char *name) {
+    for (int i = 1; i + 1 < argc; i++) {
+	if (strcmp(argv[i], name) == 0) return argv[i+1];
+    }
+    return NULL;
+}
+
+// Whether the flag name is on the command line
+bool findFlag(int argc, char *argv[], const char *name) {
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void *mapPages(long length, long pageSize) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (pageSize != PAGESIZE) {
+	int shift = (pageSize == (1L << 30)) ? 30 : 21;
+	flags |= MAP_HUGETLB | (shift << MAP_HUGE_SHIFT);
     }
-    numOfPages++;
+    return mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
 
-    void *toBeReturned = mmap(NULL, numOfPages * PAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (toBeReturned == NULL) {
-	cout << "OOps" << endl;
+// Reports, per shard, how many of the pages bound to its node actually sit
+// there according to move_pages, how many are on another node and how many
+// are not faulted in yet.
+void reportDataPlacement(void *arr, int numOfShards, intT *sizeArr, int sizeOfOneEle, long pageSize) {
+    long startByte = 0;
+    for (int i = 0; i < numOfShards; i++) {
+	long endByte = startByte + (long)sizeArr[i] * sizeOfOneEle;
+	long first = (startByte + pageSize - 1) / pageSize;
+	long last = (endByte + pageSize - 1) / pageSize;
+	if (i == 0) first = 0;
+	long count = last - first;
+	long local = 0, remote = 0, missing = 0;
+	if (count > 0) {
+	    void **pages = (void **)malloc(sizeof(void *) * count);
+	    int *status = (int *)malloc(sizeof(int) * count);
+	    for (long p = 0; p < count; p++)
+		pages[p] = (char *)arr + (first + p) * pageSize;
+	    if (move_pages(0, count, pages, NULL, status, 0) != 0) {
+		perror("move_pages");
+		missing = count;
+	    } else {
+		for (long p = 0; p < count; p++) {
+		    if (status[p] == i) local++;
+		    else if (status[p] >= 0) remote++;
+		    else missing++;
+		}
+	    }
+	    free(pages);
+	    free(status);
+	}
+	printf("placement node %d: %ld pages of %ld KiB, %ld local, %ld remote, %ld missing\n",
+	       i, count, pageSize / 1024, local, remote, missing);
+	startByte = endByte;
     }
+}
 
-    intT offset = 0;
+// Maps one array split into numOfShards consecutive shards of sizeArr[i]
+// elements, shard i bound to node i. A page belongs to the shard holding
+// its first byte, so only pages straddling two shards are split unevenly.
+// The pages are faulted in here, under the binding, so setup pays for them
+// rather than the first traversal.
+void *mapDataArray(int numOfShards, intT *sizeArr, int sizeOfOneEle) {
+    long bytes = 0;
     for (int i = 0; i < numOfShards; i++) {
-	void *startPos = (void *)((char *)toBeReturned + offset * sizeOfOneEle);
-	//printf("start binding %d : %" PRIintT "\n", i, offset);
-	numa_tonode_memory(startPos, sizeArr[i], i);
-	offset = offset + sizeArr[i];
+	bytes += (long)sizeArr[i] * sizeOfOneEle;
+    }
+    long pageSize = dataPageSize;
+    long length = (bytes / pageSize + 1) * pageSize;
+    void *toBeReturned = mapPages(length, pageSize);
+    if (toBeReturned == MAP_FAILED && pageSize != PAGESIZE) {
+	printf("no %ld KiB huge pages available, using base pages\n", pageSize / 1024);
+	pageSize = PAGESIZE;
+	length = (bytes / pageSize + 1) * pageSize;
+	toBeReturned = mapPages(length, pageSize);
     }
+    if (toBeReturned == MAP_FAILED) {
+	perror("mapDataArray");
+	exit(1);
+    }
+
+    long startByte = 0;
+    for (int i = 0; i < numOfShards; i++) {
+	long endByte = startByte + (long)sizeArr[i] * sizeOfOneEle;
+	long first = (i == 0) ? 0 : (startByte + pageSize - 1) / pageSize * pageSize;
+	long last = (i == numOfShards - 1) ? length : (endByte + pageSize - 1) / pageSize * pageSize;
+	//printf("start binding %d : %ld\n", i, first);
+	if (last > first)
+	    numa_tonode_memory((char *)toBeReturned + first, last - first, i);
+	startByte = endByte;
+    }
+    for (long p = 0; p < length; p += pageSize) {
+	((char *)toBeReturned)[p] = 0;
+    }
+    reportDataPlacement(toBeReturned, numOfShards, sizeArr, sizeOfOneEle, pageSize);
+    dataArrayLength[toBeReturned] = length;
     return toBeReturned;
 }
 
+void freeDataArray(void *arr) {
+    munmap(arr, dataArrayLength[arr]);
+    dataArrayLength.erase(arr);
+}
+
 struct AsyncChunk {
     intT accessCounter;
     intT m;
     intT *s;
 };
 
+/*
+ * The dense form of a LocalFrontier is a bitset, one bit per vertex of the
+ * node packed into 64-bit words, so that clearing, counting and packing
+ * walk n/64 words instead of n bytes. Subworkers of different nodes set
+ * bits concurrently (the pull engines write the frontiers of other nodes),
+ * so bits are set with an atomic or, skipped when already set. Plain stores
+ * are only used on whole words owned by one subworker (see subWordRange).
+ */
+static inline bool testFrontierBit(const uint64_t *b, intT i) {
+    return (b[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void setFrontierBit(uint64_t *b, intT i) {
+    uint64_t mask = 1ULL << (i & 63);
+    if (!(b[i >> 6] & mask))
+	__sync_fetch_and_or(&b[i >> 6], mask);
+}
+
+static inline void clearFrontierBit(uint64_t *b, intT i) {
+    uint64_t mask = 1ULL << (i & 63);
+    if (b[i >> 6] & mask)
+	__sync_fetch_and_and(&b[i >> 6], ~mask);
+}
+
+// Whole words of a bitset of size bits handled by one subworker
+static inline void subWordRange(intT size, int subNum, int totalSub, intT &startW, intT &endW) {
+    intT words = (size + 63) >> 6;
+    intT subSize = words / totalSub;
+    startW = subSize * subNum;
+    endW = (subNum == totalSub - 1) ? words : subSize * (subNum + 1);
+}
+
+#define PACK_BLOCK_WORDS (1024)
+
 struct LocalFrontier {
     intT n;
     intT m;
@@ -534,8 +777,9 @@ struct LocalFrontier {
     intT outEdgesCount;
     intT startID;
     intT endID;
-    bool *b;
+    uint64_t *b;
     intT *s;
+    intT sCapacity;
     intT sparseCounter;
     intT **sparseChunks;
     intT *chunkSizes;
@@ -543,20 +787,83 @@ struct LocalFrontier {
     AsyncChunk **localQueue;
     bool isDense;
 
-    LocalFrontier(bool *_b, intT start, intT end):b(_b), startID(start), endID(end), n(end - start), m(0), isDense(true), s(NULL), outEdgesCount(0), sparseChunks(NULL), chunkSizes(NULL){}
+    // b must hold wordsFor(end - start) words
+    LocalFrontier(uint64_t *_b, intT start, intT end):b(_b), startID(start), endID(end), n(end - start), m(0), isDense(true), s(NULL), sCapacity(0), outEdgesCount(0), sparseChunks(NULL), chunkSizes(NULL){}
+
+    static intT wordsFor(intT size) { return (size + 63) >> 6; }
+    intT numWords() { return wordsFor(n); }
 
     bool inRange(intT index) { return (startID <= index && index < endID);}
-    inline void setBit(intT index, bool val) { b[index-startID] = val;}
-    inline bool getBit(intT index) { return b[index-startID];}
+    inline void setBit(intT index, bool val) {
+	if (val)
+	    setFrontierBit(b, index-startID);
+	else
+	    clearFrontierBit(b, index-startID);
+    }
+    inline bool getBit(intT index) { return testFrontierBit(b, index-startID);}
 
-    void toSparse() {
-	if (isDense) {
+    void clearBits() {
+	intT words = numWords();
+	{parallel_for(intT i=0;i<words;i++) b[i] = 0;}
+    }
+
+    intT countBits() {
+	intT words = numWords();
+	intT count = 0;
+	for (intT i = 0; i < words; i++) count += __builtin_popcountll(b[i]);
+	return count;
+    }
+
+    // The sparse buffer is kept across iterations and only grows
+    intT *reserveSparse(intT len) {
+	if (len > sCapacity || s == NULL) {
 	    if (s != NULL)
 		free(s);
-	    _seq<intT> R = sequence::packIndex(b, n);
-	    s = R.A;
-	    m = R.n;
-	    {parallel_for (intT i = 0; i < m; i++) s[i] = s[i] + startID;}
+	    sCapacity = (len > 0) ? len : 1;
+	    s = (intT *)malloc(sizeof(intT) * sCapacity);
+	}
+	return s;
+    }
+
+    // Packs the set bits into s: per block of words a popcount gives the
+    // block's offset, then each word is emitted by repeated count-trailing-
+    // zeros, touching only the words that have bits set
+    void packBits() {
+	intT words = numWords();
+	intT blocks = (words + PACK_BLOCK_WORDS - 1) / PACK_BLOCK_WORDS;
+	intT *blockOffsets = (intT *)malloc(sizeof(intT) * (blocks + 1));
+	{parallel_for (intT k = 0; k < blocks; k++) {
+	    intT end = std::min(words, (k + 1) * PACK_BLOCK_WORDS);
+	    intT count = 0;
+	    for (intT w = k * PACK_BLOCK_WORDS; w < end; w++) count += __builtin_popcountll(b[w]);
+	    blockOffsets[k] = count;
+	}}
+	intT total = 0;
+	for (intT k = 0; k < blocks; k++) {
+	    intT count = blockOffsets[k];
+	    blockOffsets[k] = total;
+	    total += count;
+	}
+	intT *out = reserveSparse(total);
+	{parallel_for (intT k = 0; k < blocks; k++) {
+	    intT end = std::min(words, (k + 1) * PACK_BLOCK_WORDS);
+	    intT pos = blockOffsets[k];
+	    for (intT w = k * PACK_BLOCK_WORDS; w < end; w++) {
+		uint64_t word = b[w];
+		intT base = startID + (w << 6);
+		while (word) {
+		    out[pos++] = base + __builtin_ctzll(word);
+		    word &= word - 1;
+		}
+	    }
+	}}
+	free(blockOffsets);
+	m = total;
+    }
+
+    void toSparse() {
+	if (isDense) {
+	    packBits();
 	    if (m == 0) {
 		printf("%p\n", s);
 	    } else {
@@ -568,20 +875,15 @@ struct LocalFrontier {
 
     void toSparseAsync(int nextID, LocalFrontier* next) {
 	if (isDense) {
-	    if (s != NULL)
-		free(s);
-	    _seq<intT> R = sequence::packIndex(b, n);
-	    s = R.A;
-	    m = R.n;
-	    {parallel_for (intT i = 0; i < m; i++) s[i] = s[i] + startID;}
+	    packBits();
 	    if (m == 0) {
 		printf("%p\n", s);
 	    } else {
 		printf("M is %" PRIintT " and first ele is %" PRIintT "\n", m, s[0]);
 	    }
 	    AsyncChunk *myChunk = (AsyncChunk *)malloc(sizeof(AsyncChunk));
-	    myChunk->s = R.A;
-	    myChunk->m = R.n;
+	    myChunk->s = s;
+	    myChunk->m = m;
 	    myChunk->accessCounter = 0;
 	    next->localQueue[0] = myChunk;
 	    next->insertTail = 1;
@@ -593,8 +895,8 @@ struct LocalFrontier {
 
     void toDense() {
 	if (!isDense) {
-	    {parallel_for(intT i=0;i<n;i++) b[i] = false;}
-	    {parallel_for(intT i=0;i<m;i++) b[s[i] - startID] = true;}
+	    clearBits();
+	    {parallel_for(intT i=0;i<m;i++) setFrontierBit(b, s[i] - startID);}
 	}
 	//printf("hehe\n");
 	isDense = true;
@@ -602,11 +904,11 @@ struct LocalFrontier {
 
     void toDenseWithMerge(int numOfSub) {
 	if (!isDense) {
-	    {parallel_for(intT i=0;i<n;i++) b[i] = false;}
+	    clearBits();
 	    for (int i = 0; i < numOfSub; i++) {
 		intT *sparsePtr = sparseChunks[i];
 		intT size = chunkSizes[i];
-		{parallel_for(intT j=0;j<size;j++) b[sparsePtr[j] - startID] = true;}
+		{parallel_for(intT j=0;j<size;j++) setFrontierBit(b, sparsePtr[j] - startID);}
 	    }
 	}
 	//printf("hehe\n");
@@ -614,27 +916,34 @@ struct LocalFrontier {
     }
 
     void setSparse(intT _m, intT *_s) {
-	if (s != NULL) {
+	if (s != NULL && s != _s) {
 	    free(s);
 	}
 	m = _m;
 	s = _s;
+	sCapacity = _m;
 	isDense = false;
     }
 
-    bool *swapBitVector(bool *newB) {
-	bool *tmp = b;
+    uint64_t *swapBitVector(uint64_t *newB) {
+	uint64_t *tmp = b;
 	b = newB;
 	return tmp;
     }
 
+    // Empties the frontier; the sparse buffer is kept for reuse
     void clearFrontier() {
+	m = 0;
+	outEdgesCount = 0;
+    }
+
+    void freeSparse() {
 	if (s != NULL) {
 	    free(s);
 	}
 	s = NULL;
+	sCapacity = 0;
 	m = 0;
-	outEdgesCount = 0;
     }
 };
 
@@ -766,7 +1075,7 @@ struct vertices {
     void calculateNumOfNonZero(int nodeNum) {
 	numOfNonZero[nodeNum] = 0;
 	if (false && frontiers[nodeNum]->isDense) {
-	    numOfNonZero[nodeNum] = sequence::sum(frontiers[nodeNum]->b, numOfVertexOnNode[nodeNum]);
+	    numOfNonZero[nodeNum] = frontiers[nodeNum]->countBits();
 	    frontiers[nodeNum]->m = numOfNonZero[nodeNum];
 	} else {
 	    numOfNonZero[nodeNum] = frontiers[nodeNum]->m;
@@ -826,7 +1135,10 @@ struct vertices {
 	    accum += numOfVertexOnNode[i];
 	    i++;
 	}
-	*(frontiers[i]->b + (index - accum)) = bit;
+	if (bit)
+	    setFrontierBit(frontiers[i]->b, index - accum);
+	else
+	    clearFrontierBit(frontiers[i]->b, index - accum);
     }
 
     bool getBit(intT index) {
@@ -836,14 +1148,14 @@ struct vertices {
 	    accum += numOfVertexOnNode[i];
 	    i++;
 	}
-	return *(frontiers[i]->b + (index - accum));
+	return testFrontierBit(frontiers[i]->b, index - accum);
     }
 
-    bool *getArr(int nodeNum) {
+    uint64_t *getArr(int nodeNum) {
 	return frontiers[nodeNum]->b;
     }
 
-    bool *getNextArr(int nodeNum) {
+    uint64_t *getNextArr(int nodeNum) {
 	if (nextFrontiers[nodeNum] == NULL) return NULL;
 	return nextFrontiers[nodeNum]->b;
     }
@@ -933,9 +1245,9 @@ bool* edgeMapDense(graph<vertex> GA, vertices* frontier, F f, LocalFrontier *nex
 
     subworker.globalWait();
     intT localOffset = next->startID;
-    bool *localBitVec = frontier->getArr(subworker.tid);
+    uint64_t *localBitVec = frontier->getArr(subworker.tid);
     int currNodeNum = 0;
-    bool *currBitVector = frontier->getNextArr(currNodeNum);
+    uint64_t *currBitVector = frontier->getNextArr(currNodeNum);
     intT nextSwitchPoint = frontier->getSize(0);
     intT currOffset = 0;
     intT counter = 0;
@@ -943,21 +1255,21 @@ bool* edgeMapDense(graph<vertex> GA, vertices* frontier, F f, LocalFrontier *nex
     intT startPos = subworker.dense_start;
     intT endPos = subworker.dense_end;
 
-    while (startPos >= nextSwitchPoint) {
-	currOffset += frontier->getSize(currNodeNum);
-	nextSwitchPoint += frontier->getSize(currNodeNum + 1);
-	currNodeNum++;
-	currBitVector = frontier->getArr(currNodeNum);
-    }
-
     for (intT i = startPos; i < endPos; i++){
+	//the range spans every node's vertices: write i to its owner's next bitset
+	while (i >= nextSwitchPoint) {
+	    currOffset = nextSwitchPoint;
+	    currNodeNum++;
+	    nextSwitchPoint += frontier->getSize(currNodeNum);
+	    currBitVector = frontier->getNextArr(currNodeNum);
+	}
 	//next->setBit(i, false);
 	if (f.cond(i)) {
 	    intT d = G[i].getFakeInDegree();
 	    for(intT j=0; j<d; j++){
 		intT ngh = G[i].getInNeighbor(j);
-		if (localBitVec[ngh - localOffset] && f.updateAtomic(ngh,i)) {
-		    currBitVector[i - currOffset] = true;
+		if (testFrontierBit(localBitVec, ngh - localOffset) && f.updateAtomic(ngh,i)) {
+		    setFrontierBit(currBitVector, i - currOffset);
 		}
 		if(!f.cond(i)) break;
 		//__builtin_prefetch(f.nextPrefetchAddr(G[i].getInNeighbor(j+3)), 1, 3);
@@ -973,14 +1285,13 @@ bool* edgeMapDenseForward(graph<vertex> GA, vertices *frontier, F f, LocalFronti
     vertex *G = GA.V;
 
     int currNodeNum = 0;
-    bool *currBitVector = frontier->getArr(currNodeNum);
+    uint64_t *currBitVector = frontier->getArr(currNodeNum);
     intT nextSwitchPoint = frontier->getSize(0);
     intT currOffset = 0;
     intT counter = 0;
 
     intT m = 0;
     intT outEdgesCount = 0;
-    bool *nextB = next->b;
 
     intT startPos = 0;
     intT endPos = numVertices;
@@ -1003,7 +1314,7 @@ bool* edgeMapDenseForward(graph<vertex> GA, vertices *frontier, F f, LocalFronti
 	}
 	//printf("edgemap: %p\n", currBitVector);
 	m += G[i].getFakeDegree();
-	if (currBitVector[i-currOffset]) {
+	if (testFrontierBit(currBitVector, i-currOffset)) {
 	    intT d = G[i].getFakeDegree();
 	    for(intT j=0; j<d; j++){
 		uintT ngh = G[i].getOutNeighbor(j);
@@ -1038,17 +1349,16 @@ bool* edgeMapDenseForwardDynamic(graph<vertex> GA, vertices *frontier, F f, Loca
     intT numVertices = GA.n;
     vertex *G = GA.V;
     if (subworker.isMaster()) {
-	printf("we are here\n");
+	//printf("we are here\n");
     }
     int currNodeNum = 0;
-    bool *currBitVector = frontier->getArr(currNodeNum);
+    uint64_t *currBitVector = frontier->getArr(currNodeNum);
     intT nextSwitchPoint = frontier->getSize(0);
     intT currOffset = 0;
     intT counter = 0;
 
     intT m = 0;
     intT outEdgesCount = 0;
-    bool *nextB = next->b;
 
     intT *counterPtr = &(next->sparseCounter);
 
@@ -1072,7 +1382,7 @@ bool* edgeMapDenseForwardDynamic(graph<vertex> GA, vertices *frontier, F f, Loca
 		currBitVector = frontier->getArr(currNodeNum);
 	    }
 	    m += G[i].getFakeDegree();
-	    if (currBitVector[i-currOffset]) {
+	    if (testFrontierBit(currBitVector, i-currOffset)) {
 		intT d = G[i].getFakeDegree();
 		for(intT j=0; j<d; j++){
 		    uintT ngh = G[i].getOutNeighbor(j);
@@ -1111,9 +1421,9 @@ bool* edgeMapDenseReduce(graph<vertex> GA, vertices* frontier, F f, LocalFrontie
     gettimeofday(&startT, &tz);
 
     intT localOffset = next->startID;
-    bool *localBitVec = frontier->getArr(subworker.tid);
+    uint64_t *localBitVec = frontier->getArr(subworker.tid);
     int currNodeNum = 0;
-    bool *currBitVector = frontier->getNextArr(currNodeNum);
+    uint64_t *currBitVector = frontier->getNextArr(currNodeNum);
     intT nextSwitchPoint = frontier->getSize(0);
     intT currOffset = 0;
     intT counter = 0;
@@ -1143,8 +1453,8 @@ bool* edgeMapDenseReduce(graph<vertex> GA, vertices* frontier, F f, LocalFrontie
 	    bool shouldActive = false;
 	    for(intT j=0; j<d; j++){
 		intT ngh = G[i].getInNeighbor(j);
-		if (localBitVec[ngh - localOffset] && f.reduceFunc((void *)data, ngh)) {
-		    currBitVector[i - currOffset] = true;
+		if (testFrontierBit(localBitVec, ngh - localOffset) && f.reduceFunc((void *)data, ngh)) {
+		    setFrontierBit(currBitVector, i - currOffset);
 		    //shouldActive = true;
 		}
 		if(!f.cond(i)) break;
@@ -1181,16 +1491,15 @@ bool* edgeMapDenseDynamic(graph<vertex> GA, vertices *frontier, F f, LocalFronti
 
     subworker.globalWait();
     intT localOffset = next->startID;
-    bool *localBitVec = frontier->getArr(subworker.tid);
+    uint64_t *localBitVec = frontier->getArr(subworker.tid);
     int currNodeNum = 0;
-    bool *currBitVector = frontier->getNextArr(currNodeNum);
+    uint64_t *currBitVector = frontier->getNextArr(currNodeNum);
     intT nextSwitchPoint = frontier->getSize(0);
     intT currOffset = 0;
     intT counter = 0;
 
     intT m = 0;
     intT outEdgesCount = 0;
-    bool *nextB = next->b;
 
     intT chunkSize = numVertices / frontier->numOfNodes;
     intT rollingOffset = 0;//subworker.tid * chunkSize;
@@ -1239,8 +1548,8 @@ bool* edgeMapDenseDynamic(graph<vertex> GA, vertices *frontier, F f, LocalFronti
 		//printf("in deg of %" PRIintT ": %" PRIintT "\n", idx, d);
 		for(intT j=0; j<d; j++){
 		    uintT ngh = G[idx].getInNeighbor(j);
-		    if (localBitVec[ngh-localOffset] && f.updateAtomic(ngh, idx)) {
-			currBitVector[idx - currOffset] = true;
+		    if (testFrontierBit(localBitVec, ngh-localOffset) && f.updateAtomic(ngh, idx)) {
+			setFrontierBit(currBitVector, idx - currOffset);
 		    }
 		    if (!f.cond(idx)) {
 			break;
@@ -1266,13 +1575,12 @@ bool* edgeMapDenseBP(graph<vertex> GA, vertices *frontier, F f, LocalFrontier *n
     vertex *G = GA.V;
 
     int currNodeNum = 0;
-    bool *currBitVector = frontier->getArr(currNodeNum);
+    uint64_t *currBitVector = frontier->getArr(currNodeNum);
     intT nextSwitchPoint = frontier->getSize(0);
     intT currOffset = 0;
     intT counter = 0;
     intT m = 0;
     intT outEdgesCount = 0;
-    bool *nextB = next->b;
     intT startPos = 0;
     intT endPos = numVertices;
     if (part) {
@@ -1291,7 +1599,7 @@ bool* edgeMapDenseBP(graph<vertex> GA, vertices *frontier, F f, LocalFrontier *n
      	    currBitVector = frontier->getArr(currNodeNum);
      	}
      	m += G[i].getFakeDegree();
-     	if (currBitVector[i-currOffset]) {
+     	if (testFrontierBit(currBitVector, i-currOffset)) {
      	    intT d = G[i].getFakeDegree();
      	    for(intT j=0; j<d; j++){
      		uintT ngh = G[i].getOutNeighbor(j);
@@ -1309,7 +1617,7 @@ bool* edgeMapDenseForwardGlobalWrite(graph<vertex> GA, vertices *frontier, F f,
     intT numVertices = GA.n;
     vertex *G = GA.V;
 
-    bool *currBitVector = frontier->getArr(subworker.tid);
+    uint64_t *currBitVector = frontier->getArr(subworker.tid);
     intT currOffset = frontier->getOffset(subworker.tid);
     intT counter = 0;
 
@@ -1322,7 +1630,7 @@ bool* edgeMapDenseForwardGlobalWrite(graph<vertex> GA, vertices *frontier, F f,
     //printf("%d %d: start-end: %" PRIintT " %" PRIintT "\n", subworker.tid, subworker.subTid, startPos, endPos);
 
     int currNodeNum = frontier->getNodeNumOfIndex(startPos);
-    bool *nextBitVector = nexts[currNodeNum]->b;
+    uint64_t *nextBitVector = nexts[currNodeNum]->b;
     intT nextSwitchPoint = frontier->getOffset(currNodeNum+1);
     intT offset = frontier->getOffset(currNodeNum);
 
@@ -1338,8 +1646,8 @@ bool* edgeMapDenseForwardGlobalWrite(graph<vertex> GA, vertices *frontier, F f,
 	    intT d = G[i].getFakeDegree();
 	    for(intT j=0; j<d; j++){
 		uintT ngh = G[i].getInNeighbor(j);
-		if (currBitVector[ngh-currOffset] && f.updateAtomic(ngh, i)) {
-		    nextBitVector[i-offset] = true;
+		if (testFrontierBit(currBitVector, ngh-currOffset) && f.updateAtomic(ngh, i)) {
+		    setFrontierBit(nextBitVector, i-offset);
 		}
 	    }
 	}
@@ -1771,7 +2079,7 @@ void edgeMapSparseV5(graph<vertex> GA, vertices *frontier, F f, LocalFrontier *n
 	next->outEdgesCount = 0;
 	intT bufferLen = frontier->getEdgeStat();
 	if (subworker.isSubMaster()) {
-	    next->s = (intT *)malloc(sizeof(intT) * bufferLen);
+	    next->reserveSparse(bufferLen);
 	}
 	intT nextEdgesCount = 0;
 
@@ -1938,7 +2246,7 @@ void edgeMapSparseV3(graph<vertex> GA, vertices *frontier, F f, LocalFrontier *n
 	next->outEdgesCount = 0;
 	intT bufferLen = frontier->getEdgeStat();
 	if (subworker.isSubMaster())
-	    next->s = (intT *)malloc(sizeof(intT) * bufferLen);
+	    next->reserveSparse(bufferLen);
 	intT nextEdgesCount = 0;
 
 	//pthread_barrier_wait(subworker.local_barr);
@@ -2082,9 +2390,7 @@ void edgeMapSparseV2(graph<vertex> GA, vertices *frontier, F f, LocalFrontier *n
 	if (subworker.isSubMaster()) {
 	    //printf("next of %d: %" PRIintT " %" PRIintT "\n", subworker.tid, next->m, nextM);
 	    if (next->m > 0) {
-		intT *sparseArr = (intT *)malloc(sizeof(intT) * next->m);
-		//printf("next sparse: %p\n", sparseArr);
-		next->s = sparseArr;
+		next->reserveSparse(next->m);
 	    }
 	    next->isDense = false;
 	}
@@ -2237,7 +2543,200 @@ void switchFrontier(int nodeNum, vertices *V, LocalFrontier* &next) {
 
 void clearLocalFrontier(LocalFrontier *next, int nodeNum, int subNum, int totalSub);
 
-// decides on sparse or dense base on number of nonzeros in the active vertices
+/*
+ * The edgeMap engines that can stand in for one another from one iteration
+ * to the next. Each is entered once the frontier has been converted and all
+ * workers have passed a global barrier, and each leaves next as a dense bit
+ * vector or as a sparse list with m and outEdgesCount set. The pull engines
+ * read in-edges from local sources, so they need a graph built by
+ * graphFilter2Direction and are never used when edgeMap is given
+ * DENSE_FORWARD. They also set bits on other nodes, so the caller must wait
+ * globally before counting next. edgeMapDenseReduce (reducing functors),
+ * edgeMapDenseBP, edgeMapSparseV4 (chunked frontiers) and
+ * edgeMapSparseV5/Async/AsyncPipe (whole traversals) do not fit and are
+ * left out.
+ */
+enum edgeMapEngine {
+    SPARSE_V2, SPARSE_V3, DENSE_PULL, DENSE_PULL_DYNAMIC, DENSE_PUSH, DENSE_PUSH_DYNAMIC,
+    NUM_ENGINES
+};
+
+const char *edgeMapEngineNames[NUM_ENGINES] = {
+    "sparseV2", "sparseV3", "dense", "denseDynamic", "denseForward", "denseForwardDynamic"
+};
+
+inline bool isDenseEngine(int engine) { return engine >= DENSE_PULL; }
+inline bool isPullEngine(int engine) { return engine == DENSE_PULL || engine == DENSE_PULL_DYNAMIC; }
+
+/*
+ * Picks the engine of every edgeMap call. By default the threshold decides
+ * between sparse and dense and the engines are the historical ones
+ * (edgeMapSparseV3, and edgeMapDenseForward or edgeMapDenseDynamic);
+ * -edgemap can name other ones. In auto mode the master times (or meters)
+ * every call from its start to the start of the next one, divides by the
+ * frontier's vertices and out-edges, and keeps a running average per
+ * engine and density band (band b holds frontiers of about 1/2^b of the
+ * edges). Each band tries every engine once, then runs the cheapest,
+ * switching if its average falls behind. Sparse engines are only tried
+ * below 1/4 of the edges, where their per-worker buffers stay small.
+ * Calls given DENSE_FORWARD keep their own bands, since the pull engines
+ * are not open to them. The choice is published across one extra global
+ * barrier per call.
+ */
+struct EdgeMapTuner {
+    static const int kBands = 16;
+    static const int kKinds = 2; //any engine, or DENSE_FORWARD only
+
+    int sparseEngine;
+    int denseEngine;
+    bool tune;
+    bool byEnergy;
+    volatile int current;
+
+    double cost[kKinds][kBands][NUM_ENGINES];
+    int trials[kKinds][kBands][NUM_ENGINES];
+    int best[kKinds][kBands];
+
+    bool pending;
+    int pendingKind, pendingBand, pendingEngine;
+    double pendingWork, pendingStart;
+    struct rapl_snapshot pendingSnap;
+
+    EdgeMapTuner():sparseEngine(SPARSE_V3), denseEngine(-1), tune(false), byEnergy(false), current(0), pending(false) {
+	for (int k = 0; k < kKinds; k++) {
+	    for (int b = 0; b < kBands; b++) {
+		best[k][b] = -1;
+		for (int e = 0; e < NUM_ENGINES; e++) {
+		    cost[k][b][e] = 0.0;
+		    trials[k][b][e] = 0;
+		}
+	    }
+	}
+    }
+
+    // Parses -edgemap: auto, auto-energy, or engine names separated by
+    // commas, each replacing the sparse or the dense engine
+    void configure(const char *opt) {
+	if (opt == NULL) return;
+	tune = (strncmp(opt, "auto", 4) == 0);
+	byEnergy = (strcmp(opt, "auto-energy") == 0);
+	if (tune) return;
+	char buf[256];
+	strncpy(buf, opt, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	for (char *name = strtok(buf, ","); name != NULL; name = strtok(NULL, ",")) {
+	    int e = 0;
+	    while (e < NUM_ENGINES && strcmp(name, edgeMapEngineNames[e]) != 0) e++;
+	    if (e == NUM_ENGINES)
+		printf("unknown edgeMap engine %s\n", name);
+	    else if (isDenseEngine(e))
+		denseEngine = e;
+	    else
+		sparseEngine = e;
+	}
+    }
+
+    // Engine for a call when not tuning; every worker computes the same one
+    int fixedEngine(bool dense, char option) {
+	if (!dense)
+	    return sparseEngine;
+	int e = denseEngine;
+	if (e < 0)
+	    e = (option == DENSE_FORWARD) ? DENSE_PUSH : DENSE_PULL_DYNAMIC;
+	if (option == DENSE_FORWARD && isPullEngine(e))
+	    e = DENSE_PUSH;
+	return e;
+    }
+
+    static int bandOf(long long m, long long numEdges) {
+	int band = 0;
+	for (long long part = numEdges / 2; band < kBands - 1 && m < part; part /= 2)
+	    band++;
+	return band;
+    }
+
+    static double now() {
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return ((double)t.tv_sec) + ((double)t.tv_usec) / 1000000.0;
+    }
+
+    static int kindOf(char option) { return (option == DENSE_FORWARD) ? 1 : 0; }
+
+    void updateBest(int kind, int band) {
+	double *c = cost[kind][band];
+	int *t = trials[kind][band];
+	int &b = best[kind][band];
+	b = -1;
+	for (int e = 0; e < NUM_ENGINES; e++) {
+	    if (t[e] == 0) continue;
+	    if (b < 0 || c[e] / t[e] < c[b] / t[b])
+		b = e;
+	}
+    }
+
+    // Charges the call in flight with everything since it started
+    void finishCall() {
+	if (!pending) return;
+	pending = false;
+	double spent = now() - pendingStart;
+	if (byEnergy) {
+	    struct rapl_snapshot snap;
+	    read_rapl_snapshot(&snap);
+	    spent = rapl_snapshot_energy(&pendingSnap, &snap);
+	}
+	cost[pendingKind][pendingBand][pendingEngine] += spent / pendingWork;
+	trials[pendingKind][pendingBand][pendingEngine]++;
+	updateBest(pendingKind, pendingBand);
+    }
+
+    // Called by the master at the start of a call
+    int choose(long long m, long long numEdges, char option) {
+	finishCall();
+	int kind = kindOf(option);
+	int band = bandOf(m, numEdges);
+	int engine = -1;
+	for (int e = 0; e < NUM_ENGINES && engine < 0; e++) {
+	    if (option == DENSE_FORWARD && isPullEngine(e)) continue;
+	    if (!isDenseEngine(e) && band < 2) continue;
+	    if (trials[kind][band][e] == 0) engine = e;
+	}
+	if (engine < 0)
+	    engine = best[kind][band];
+	pending = true;
+	pendingKind = kind;
+	pendingBand = band;
+	pendingEngine = engine;
+	pendingWork = (m > 0) ? (double)m : 1.0;
+	if (byEnergy)
+	    read_rapl_snapshot(&pendingSnap);
+	pendingStart = now();
+	current = engine;
+	return engine;
+    }
+
+    void report() {
+	if (!tune) return;
+	for (int k = 0; k < kKinds; k++) {
+	    for (int b = 0; b < kBands; b++) {
+		if (best[k][b] < 0) continue;
+		printf("edgeMap %sband %d (~1/%lld of edges): %s,", k ? "forward-only " : "", b,
+		       1LL << (b + 1), edgeMapEngineNames[best[k][b]]);
+		for (int e = 0; e < NUM_ENGINES; e++) {
+		    if (trials[k][b][e] > 0)
+			printf(" %s %.3e", edgeMapEngineNames[e], cost[k][b][e] / trials[k][b][e]);
+		}
+		printf(" %s per vertex or edge\n", byEnergy ? "J" : "s");
+	    }
+	}
+    }
+};
+
+EdgeMapTuner edgeMapTuner;
+
+// runs the sparse or dense engine picked by edgeMapTuner; by default the
+// threshold decides on sparse or dense base on number of nonzeros in the
+// active vertices
 template <class F, class vertex>
 void edgeMap(graph<vertex> GA, vertices *V, F f, LocalFrontier *next, intT threshold = -1,
 	     char option=DENSE, bool remDups=false, bool part = false, Subworker_Partitioner &subworker = dummyPartitioner) {
@@ -2246,18 +2745,19 @@ void edgeMap(graph<vertex> GA, vertices *V, F f, LocalFrontier *next, intT thres
     vertex *G = GA.V;
     long long m = (long long)V->numNonzeros() + V->getEdgeStat();
 
-    if (subworker.isMaster()) {
-	//printf("%" PRIintT " %" PRIintT "\n", V->numNonzeros(), threshold);
-    }
-
-    /*
-    if (subworker.isMaster())
-	printf("%" PRIintT "\n", m);
-    */
     intT start = subworker.dense_start;
     intT end = subworker.dense_end;
 
-    if (m >= threshold) {
+    int engine = edgeMapTuner.fixedEngine(m >= threshold, option);
+    if (edgeMapTuner.tune) {
+	if (subworker.isMaster()) {
+	    edgeMapTuner.choose(m, numEdges, option);
+	}
+	subworker.globalWait();
+	engine = edgeMapTuner.current;
+    }
+
+    if (isDenseEngine(engine)) {
 	//Dense part
 	if (subworker.isMaster()) {
 	    //printf("Dense: %lld\n", m);
@@ -2273,11 +2773,20 @@ void edgeMap(graph<vertex> GA, vertices *V, F f, LocalFrontier *next, intT thres
 	//pthread_barrier_wait(subworker.global_barr);
 	subworker.globalWait();
 
-	bool* R = (option == DENSE_FORWARD) ?
-	    edgeMapDenseForward(GA, V, f, next, part, start, end) :
-	    //edgeMapDenseForwardDynamic(GA, V, f, next, subworker) :
-	    //edgeMapDense(GA, V, f, next, option, subworker);
-            edgeMapDenseDynamic(GA, V, f, next, subworker);
+	switch (engine) {
+	case DENSE_PULL:
+	    edgeMapDense(GA, V, f, next, option, subworker);
+	    break;
+	case DENSE_PULL_DYNAMIC:
+	    edgeMapDenseDynamic(GA, V, f, next, subworker);
+	    break;
+	case DENSE_PUSH:
+	    edgeMapDenseForward(GA, V, f, next, part, start, end);
+	    break;
+	case DENSE_PUSH_DYNAMIC:
+	    edgeMapDenseForwardDynamic(GA, V, f, next, subworker);
+	    break;
+	}
 	next->isDense = true;
     } else {
 	//Sparse part
@@ -2285,23 +2794,13 @@ void edgeMap(graph<vertex> GA, vertices *V, F f, LocalFrontier *next, intT thres
 	    //printf("Sparse: %" PRIintT " %lld\n", V->numNonzeros(), m);
 	    V->toSparse();
 	}
-	/*
-	if (subworker.isSubMaster()) {
-	    if (next->sparseChunks == NULL) {
-		next->sparseChunks = (intT **)malloc(sizeof(intT *) * subworker.numOfSub);
-	    }
-	    if (next->chunkSizes == NULL) {
-		next->chunkSizes = (intT *)malloc(sizeof(intT) * subworker.numOfSub);
-	    }
-	}
-	*/
 	//pthread_barrier_wait(subworker.global_barr);
 	subworker.globalWait();
-	if (V->firstSparse && subworker.isMaster()) {
-	    //printf("my first sparse\n");
-	}
 
-	edgeMapSparseV3(GA, V, f, next, part, subworker);
+	if (engine == SPARSE_V2)
+	    edgeMapSparseV2(GA, V, f, next, part, subworker);
+	else
+	    edgeMapSparseV3(GA, V, f, next, part, subworker);
 	//edgeMapSparseV4(GA, V, f, next, V->firstSparse, subworker);
 	//edgeMapSparseV5(GA, V, f, next, subworker);
 	next->isDense = false;
@@ -2316,21 +2815,19 @@ void vertexCounter(graph<vertex> GA, LocalFrontier *frontier, int nodeNum, int s
 
     intT size = frontier->endID - frontier->startID;
     intT offset = frontier->startID;
-    bool *b = frontier->b;
-    intT subSize = size / totalSub;
-    intT startPos = subSize * subNum;
-    intT endPos = subSize * (subNum + 1);
-    if (subNum == totalSub - 1) {
-	endPos = size;
-    }
+    uint64_t *b = frontier->b;
+    intT startW, endW;
+    subWordRange(size, subNum, totalSub, startW, endW);
 
     intT m = 0;
     intT outEdges = 0;
 
-    for (intT i = startPos; i < endPos; i++) {
-	if (b[i]) {
-	    outEdges += GA.V[i+offset].getOutDegree();
-	    m++;
+    for (intT w = startW; w < endW; w++) {
+	uint64_t word = b[w];
+	m += __builtin_popcountll(word);
+	while (word) {
+	    outEdges += GA.V[offset + (w << 6) + __builtin_ctzll(word)].getOutDegree();
+	    word &= word - 1;
 	}
     }
     __sync_fetch_and_add(&(frontier->m), m);
@@ -2341,10 +2838,11 @@ template <class F>
 void vertexMap(vertices *V, F add, int nodeNum) {
     intT size = V->getSize(nodeNum);
     intT offset = V->getOffset(nodeNum);
-    bool *b = V->getArr(nodeNum);
-    for (intT i = 0; i < size; i++) {
-	if (b[i])
-	    add(i + offset);
+    uint64_t *b = V->getArr(nodeNum);
+    intT words = LocalFrontier::wordsFor(size);
+    for (intT w = 0; w < words; w++) {
+	for (uint64_t word = b[w]; word; word &= word - 1)
+	    add(offset + (w << 6) + __builtin_ctzll(word));
     }
 }
 
@@ -2353,17 +2851,13 @@ void vertexMap(vertices *V, F add, int nodeNum, int subNum, int totalSub) {
     if (V->isDense) {
 	intT size = V->getSize(nodeNum);
 	intT offset = V->getOffset(nodeNum);
-	bool *b = V->getArr(nodeNum);
-	intT subSize = size / totalSub;
-	intT startPos = subSize * subNum;
-	intT endPos = subSize * (subNum + 1);
-	if (subNum == totalSub - 1) {
-	    endPos = size;
-	}
+	uint64_t *b = V->getArr(nodeNum);
+	intT startW, endW;
+	subWordRange(size, subNum, totalSub, startW, endW);
 
-	for (intT i = startPos; i < endPos; i++) {
-	    if (b[i])
-		add(i + offset);
+	for (intT w = startW; w < endW; w++) {
+	    for (uint64_t word = b[w]; word; word &= word - 1)
+		add(offset + (w << 6) + __builtin_ctzll(word));
 	}
     } else {
 	intT size = V->frontiers[nodeNum]->m;
@@ -2383,28 +2877,29 @@ void vertexMap(vertices *V, F add, int nodeNum, int subNum, int totalSub) {
 void clearLocalFrontier(LocalFrontier *next, int nodeNum, int subNum, int totalSub) {
     intT size = next->endID - next->startID;
     //intT offset = V->getOffset(nodeNum);
-    bool *b = next->b;
-    intT subSize = size / totalSub;
-    intT startPos = subSize * subNum;
-    intT endPos = subSize * (subNum + 1);
-    if (subNum == totalSub - 1) {
-	endPos = size;
-    }
+    uint64_t *b = next->b;
+    intT startW, endW;
+    subWordRange(size, subNum, totalSub, startW, endW);
 
-    for (intT i = startPos; i < endPos; i++) {
-	b[i] = false;
+    for (intT w = startW; w < endW; w++) {
+	b[w] = 0;
     }
 }
 
 template <class F>
-void vertexFilter(vertices *V, F filter, int nodeNum, bool *result) {
+void vertexFilter(vertices *V, F filter, int nodeNum, uint64_t *result) {
     intT size = V->getSize(nodeNum);
     intT offset = V->getOffset(nodeNum);
-    bool *b = V->getArr(nodeNum);
-    for (intT i = 0; i < size; i++) {
-	result[i] = false;
-	if (b[i])
-	    result[i] = filter(i + offset);
+    uint64_t *b = V->getArr(nodeNum);
+    intT words = LocalFrontier::wordsFor(size);
+    for (intT w = 0; w < words; w++) {
+	uint64_t out = 0;
+	for (uint64_t word = b[w]; word; word &= word - 1) {
+	    int bit = __builtin_ctzll(word);
+	    if (filter(offset + (w << 6) + bit))
+		out |= 1ULL << bit;
+	}
+	result[w] = out;
     }
 }
 
@@ -2412,29 +2907,25 @@ template <class F>
 void vertexFilter(vertices *V, F filter, int nodeNum, int subNum, int totalSub, LocalFrontier *result) {
     intT size = V->getSize(nodeNum);
     intT offset = V->getOffset(nodeNum);
-    bool *b = V->getArr(nodeNum);
-    intT subSize = size / totalSub;
-    intT startPos = subSize * subNum;
-    intT endPos = subSize * (subNum + 1);
-    if (subNum == totalSub - 1) {
-	endPos = size;
-    }
+    uint64_t *b = V->getArr(nodeNum);
+    intT startW, endW;
+    subWordRange(size, subNum, totalSub, startW, endW);
 
-    bool *dst = result->b;
+    uint64_t *dst = result->b;
     intT m = 0;
     /*
     if (size != result->endID - result->startID || offset != result->startID)
 	printf("oops\n");
     */
-    for (intT i = startPos; i < endPos; i++) {
-	//result->setBit(i+offset, b[i] ? (filter(i+offset)) : (false));
-	if (b[i]) {
-	    dst[i] = filter(i + offset);
-	    if (dst[i])
-		m++;
-	} else {
-	    dst[i] = false;
-	}
+    for (intT w = startW; w < endW; w++) {
+	uint64_t out = 0;
+	for (uint64_t word = b[w]; word; word &= word - 1) {
+	    int bit = __builtin_ctzll(word);
+	    if (filter(offset + (w << 6) + bit))
+		out |= 1ULL << bit;
+	}
+	dst[w] = out;
+	m += __builtin_popcountll(out);
     }
     //printf("filter over\n");
     writeAdd(&(result->m), m);